@@ -0,0 +1,313 @@
+/*
+ * cdc_crc.c  --  CDC Display Controller frame CRC capture
+ *
+ * Copyright (C) 2017 TES Electronic Solutions GmbH
+ * Author: Christian Thaler <christian.thaler@tes-dst.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * The CDC CRC unit checks every frame and raises CDC_IRQ_CRC_ERROR on a
+ * mismatch. The CRC value itself is not readable, so each captured frame
+ * yields its verdict instead: 0 if the frame matched, 1 if it did not.
+ *
+ * The debugfs interface follows the layout of the DRM CRC interface:
+ * writing "auto" to crc/control starts the capture, "none" stops it.
+ * crc/data returns one "<frame> <verdict>" line per vblank.
+ */
+
+#include <linux/circ_buf.h>
+#include <linux/debugfs.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+
+#include <drm/drmP.h>
+
+#include "cdc_regs.h"
+#include "cdc_drv.h"
+#include "cdc_hw.h"
+#include "cdc_crc.h"
+
+#define CDC_CRC_ENTRIES 128
+#define CDC_CRC_LINE_LEN (2 * 10 + 2) /* "0x%08x 0x%08x\n" */
+
+struct cdc_crc_entry {
+	u32 frame;
+	u32 error;
+};
+
+struct cdc_crc {
+	struct cdc_device *cdc;
+	struct dentry *dir;
+
+	spinlock_t lock;
+	wait_queue_head_t wait;
+	bool enabled;
+	bool vblank_ref;
+	bool error; /* mismatch reported for the current frame */
+	struct cdc_crc_entry entries[CDC_CRC_ENTRIES];
+	unsigned int head;
+	unsigned int tail;
+};
+
+static unsigned int cdc_crc_count (struct cdc_crc *crc)
+{
+	return CIRC_CNT(crc->head, crc->tail, CDC_CRC_ENTRIES);
+}
+
+int cdc_crc_init (struct cdc_device *cdc)
+{
+	struct cdc_crc *crc;
+
+	crc = devm_kzalloc(cdc->dev, sizeof(*crc), GFP_KERNEL);
+	if (crc == NULL)
+		return -ENOMEM;
+
+	crc->cdc = cdc;
+	spin_lock_init(&crc->lock);
+	init_waitqueue_head(&crc->wait);
+	cdc->crc = crc;
+
+	return 0;
+}
+
+static void cdc_crc_enable (struct cdc_crc *crc, bool enable)
+{
+	struct cdc_device *cdc = crc->cdc;
+	unsigned long flags;
+	bool changed;
+
+	spin_lock_irqsave(&crc->lock, flags);
+	changed = crc->enabled != enable;
+	crc->enabled = enable;
+	crc->error = false;
+	if (enable)
+		crc->head = crc->tail = 0;
+	spin_unlock_irqrestore(&crc->lock, flags);
+
+	if (!changed)
+		return;
+
+	/* Keep the line IRQ running, entries are added per vblank */
+	if (enable) {
+		crc->vblank_ref = drm_crtc_vblank_get(&cdc->crtc) == 0;
+		cdc_irq_set(cdc, CDC_IRQ_CRC_ERROR, true);
+	} else {
+		if (crc->vblank_ref)
+			drm_crtc_vblank_put(&cdc->crtc);
+		crc->vblank_ref = false;
+		wake_up_interruptible(&crc->wait);
+	}
+}
+
+bool cdc_crc_irq (struct cdc_device *cdc, u32 status)
+{
+	struct cdc_crc *crc = cdc->crc;
+	bool consumed;
+
+	if (crc == NULL || !(status & CDC_IRQ_CRC_ERROR))
+		return false;
+
+	spin_lock(&crc->lock);
+	consumed = crc->enabled;
+	crc->error |= consumed;
+	spin_unlock(&crc->lock);
+
+	return consumed;
+}
+
+void cdc_crc_frame_done (struct cdc_device *cdc, u32 frame)
+{
+	struct cdc_crc *crc = cdc->crc;
+	struct cdc_crc_entry *entry;
+
+	if (crc == NULL)
+		return;
+
+	spin_lock(&crc->lock);
+	if (!crc->enabled) {
+		spin_unlock(&crc->lock);
+		return;
+	}
+
+	/* Drop the oldest entry if nobody reads them fast enough */
+	if (CIRC_SPACE(crc->head, crc->tail, CDC_CRC_ENTRIES) == 0)
+		crc->tail = (crc->tail + 1) & (CDC_CRC_ENTRIES - 1);
+
+	entry = &crc->entries[crc->head];
+	entry->frame = frame;
+	entry->error = crc->error;
+	crc->error = false;
+	crc->head = (crc->head + 1) & (CDC_CRC_ENTRIES - 1);
+	spin_unlock(&crc->lock);
+
+	wake_up_interruptible(&crc->wait);
+}
+
+static int cdc_crc_control_show (struct seq_file *m, void *arg)
+{
+	struct cdc_crc *crc = m->private;
+
+	seq_printf(m, "%s\n", crc->enabled ? "auto" : "none");
+
+	return 0;
+}
+
+static int cdc_crc_control_open (struct inode *inode, struct file *file)
+{
+	return single_open(file, cdc_crc_control_show, inode->i_private);
+}
+
+static ssize_t cdc_crc_control_write (struct file *file,
+	const char __user *ubuf, size_t len, loff_t *offp)
+{
+	struct seq_file *m = file->private_data;
+	struct cdc_crc *crc = m->private;
+	char buf[8];
+
+	if (len == 0 || len >= sizeof(buf))
+		return -EINVAL;
+
+	if (copy_from_user(buf, ubuf, len))
+		return -EFAULT;
+
+	buf[len] = '\0';
+
+	if (sysfs_streq(buf, "auto"))
+		cdc_crc_enable(crc, true);
+	else if (sysfs_streq(buf, "none"))
+		cdc_crc_enable(crc, false);
+	else
+		return -EINVAL;
+
+	return len;
+}
+
+static const struct file_operations cdc_crc_control_fops = {
+	.owner = THIS_MODULE,
+	.open = cdc_crc_control_open,
+	.read = seq_read,
+	.write = cdc_crc_control_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static bool cdc_crc_readable (struct cdc_crc *crc)
+{
+	unsigned long flags;
+	bool readable;
+
+	spin_lock_irqsave(&crc->lock, flags);
+	readable = cdc_crc_count(crc) > 0 || !crc->enabled;
+	spin_unlock_irqrestore(&crc->lock, flags);
+
+	return readable;
+}
+
+static ssize_t cdc_crc_data_read (struct file *file, char __user *ubuf,
+	size_t len, loff_t *offp)
+{
+	struct cdc_crc *crc = file->private_data;
+	char line[CDC_CRC_LINE_LEN + 1];
+	struct cdc_crc_entry entry;
+	unsigned long flags;
+	ssize_t copied = 0;
+	int ret;
+
+	if (len < CDC_CRC_LINE_LEN)
+		return -EINVAL;
+
+	if (!(file->f_flags & O_NONBLOCK)) {
+		ret = wait_event_interruptible(crc->wait,
+			cdc_crc_readable(crc));
+		if (ret)
+			return ret;
+	}
+
+	while (len - copied >= CDC_CRC_LINE_LEN) {
+		spin_lock_irqsave(&crc->lock, flags);
+		if (cdc_crc_count(crc) == 0) {
+			spin_unlock_irqrestore(&crc->lock, flags);
+			break;
+		}
+		entry = crc->entries[crc->tail];
+		crc->tail = (crc->tail + 1) & (CDC_CRC_ENTRIES - 1);
+		spin_unlock_irqrestore(&crc->lock, flags);
+
+		snprintf(line, sizeof(line), "0x%08x 0x%08x\n", entry.frame,
+			entry.error);
+		if (copy_to_user(ubuf + copied, line, CDC_CRC_LINE_LEN))
+			return -EFAULT;
+
+		copied += CDC_CRC_LINE_LEN;
+	}
+
+	if (copied == 0 && (file->f_flags & O_NONBLOCK))
+		return -EAGAIN;
+
+	return copied;
+}
+
+static unsigned int cdc_crc_data_poll (struct file *file, poll_table *wait)
+{
+	struct cdc_crc *crc = file->private_data;
+	unsigned long flags;
+	unsigned int ret = 0;
+
+	poll_wait(file, &crc->wait, wait);
+
+	spin_lock_irqsave(&crc->lock, flags);
+	if (cdc_crc_count(crc) > 0)
+		ret |= POLLIN | POLLRDNORM;
+	spin_unlock_irqrestore(&crc->lock, flags);
+
+	return ret;
+}
+
+static const struct file_operations cdc_crc_data_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = cdc_crc_data_read,
+	.poll = cdc_crc_data_poll,
+	.llseek = no_llseek,
+};
+
+int cdc_crc_debugfs_init (struct cdc_device *cdc, struct dentry *root)
+{
+	struct cdc_crc *crc = cdc->crc;
+
+	if (crc == NULL)
+		return 0;
+
+	crc->dir = debugfs_create_dir("crc", root);
+	if (crc->dir == NULL)
+		return -ENOMEM;
+
+	if (debugfs_create_file("control", S_IRUGO | S_IWUSR, crc->dir, crc,
+			&cdc_crc_control_fops) == NULL
+		|| debugfs_create_file("data", S_IRUGO, crc->dir, crc,
+			&cdc_crc_data_fops) == NULL) {
+		debugfs_remove_recursive(crc->dir);
+		crc->dir = NULL;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+void cdc_crc_debugfs_cleanup (struct cdc_device *cdc)
+{
+	struct cdc_crc *crc = cdc->crc;
+
+	if (crc == NULL)
+		return;
+
+	cdc_crc_enable(crc, false);
+	debugfs_remove_recursive(crc->dir);
+	crc->dir = NULL;
+}
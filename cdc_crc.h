@@ -0,0 +1,27 @@
+/*
+ * cdc_crc.h  --  CDC Display Controller frame CRC capture
+ *
+ * Copyright (C) 2017 TES Electronic Solutions GmbH
+ * Author: Christian Thaler <christian.thaler@tes-dst.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef CDC_CRC_H_
+#define CDC_CRC_H_
+
+#include <linux/types.h>
+
+struct cdc_device;
+struct dentry;
+
+int cdc_crc_init (struct cdc_device *cdc);
+bool cdc_crc_irq (struct cdc_device *cdc, u32 status);
+void cdc_crc_frame_done (struct cdc_device *cdc, u32 frame);
+int cdc_crc_debugfs_init (struct cdc_device *cdc, struct dentry *root);
+void cdc_crc_debugfs_cleanup (struct cdc_device *cdc);
+
+#endif /* CDC_CRC_H_ */
@@ -21,9 +21,13 @@
 #include "cdc_regs.h"
 #include "cdc_drv.h"
 #include "cdc_kms.h"
+#include "cdc_crtc.h"
 #include "cdc_plane.h"
 #include "cdc_hw.h"
 #include "cdc_hw_helpers.h"
+#include "cdc_sim.h"
+#include "cdc_crc.h"
+#include "cdc_trace.h"
 
 static struct cdc_device *to_cdc_dev (struct drm_crtc *c)
 {
@@ -79,7 +83,51 @@ static void cdc_crtc_set_display_timing (struct drm_crtc *crtc)
 		mode->crtc_vsync_start - mode->crtc_vdisplay,  // vfront porch
 		neg_hsync, neg_hsync, neg_blank, inv_clock);
 
+	/* Used for the vblank timestamps, see cdc_crtc_get_scanout_position */
+	drm_mode_copy(&crtc->hwmode, mode);
+	drm_calc_timestamping_constants(crtc, mode);
+
 	clk_set_rate(cdc->pclk, mode->crtc_clock * 1000);
+	if (cdc->sim)
+		cdc_sim_set_pixel_clock(cdc->sim, mode->crtc_clock);
+}
+
+/* Returns the scanout position relative to the first active pixel. The
+ * CDC counts lines and pixels from the start of the sync pulses, so the
+ * back porch is negative and the front porch is mapped to the end of the
+ * previous frame as the DRM core expects.
+ */
+int cdc_crtc_get_scanout_position (struct drm_crtc *crtc, unsigned int flags,
+	int *vpos, int *hpos, ktime_t *stime, ktime_t *etime,
+	const struct drm_display_mode *mode)
+{
+	struct cdc_device *cdc = to_cdc_dev(crtc);
+	int vactive_start = mode->crtc_vtotal - mode->crtc_vsync_start;
+	int hactive_start = mode->crtc_htotal - mode->crtc_hsync_start;
+	int ret = DRM_SCANOUTPOS_VALID | DRM_SCANOUTPOS_ACCURATE;
+	u32 pos;
+
+	if (!cdc->hw.enabled)
+		return 0;
+
+	if (stime)
+		*stime = ktime_get();
+
+	pos = cdc_read_reg(cdc, CDC_REG_GLOBAL_POSITION);
+
+	if (etime)
+		*etime = ktime_get();
+
+	*vpos = (int) (pos & 0xffff) - vactive_start;
+	*hpos = (int) (pos >> 16) - hactive_start;
+
+	if (*vpos >= mode->crtc_vdisplay)
+		*vpos -= mode->crtc_vtotal;
+
+	if (*vpos < 0)
+		ret |= DRM_SCANOUTPOS_IN_VBLANK;
+
+	return ret;
 }
 
 void cdc_crtc_cancel_page_flip (struct drm_crtc *crtc, struct drm_file *file)
@@ -122,7 +170,153 @@ static void cdc_crtc_finish_page_flip (struct drm_crtc *crtc)
 	wake_up(&cdc->flip_wait);
 	spin_unlock_irqrestore(&dev->event_lock, flags);
 
+	trace_cdc_vblank_event(cdc, crtc);
+
+	drm_crtc_vblank_put(crtc);
+}
+
+/* Completes the commit waiting for its shadow reload, if any. With
+ * check_reload set, this only happens once the hardware has latched the
+ * registers.
+ */
+static void cdc_crtc_complete_commit (struct drm_crtc *crtc, bool check_reload)
+{
+	struct cdc_device *cdc = to_cdc_dev(crtc);
+	struct cdc_commit *commit;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cdc->commit.lock, flags);
+	commit = cdc->commit.armed;
+	if (commit && check_reload
+		&& (cdc_read_reg(cdc, CDC_REG_GLOBAL_SHADOW_RELOAD)
+			& CDC_REG_GLOBAL_SHADOW_RELOAD_VBLANK))
+		commit = NULL;
+	if (commit) {
+		cdc->commit.armed = NULL;
+
+		if (check_reload && (s32) (drm_crtc_vblank_count(crtc)
+			- commit->target) <= 0)
+			cdc->commit.stats.made++;
+		else
+			cdc->commit.stats.missed++;
+	}
+	spin_unlock_irqrestore(&cdc->commit.lock, flags);
+
+	if (commit == NULL)
+		return;
+
+	cdc_hw_applyBackgroundLayer(cdc);
+	commit->t_reload = ktime_get();
+	cdc_crtc_finish_page_flip(crtc);
+	commit->t_event = ktime_get();
+	wake_up(&cdc->flip_wait);
 	drm_crtc_vblank_put(crtc);
+
+	cdc_atomic_commit_done(commit);
+}
+
+/* Writes the cached registers of the commit and arms the shadow reload for
+ * the next vblank. Returns false without shadow registers, the update is
+ * visible right away then.
+ */
+static bool cdc_crtc_arm_commit (struct drm_crtc *crtc,
+	struct cdc_commit *commit)
+{
+	struct cdc_device *cdc = to_cdc_dev(crtc);
+	unsigned long flags;
+	unsigned int written;
+	bool armed;
+
+	written = cdc_hw_regcache_flush(cdc);
+	commit->t_written = ktime_get();
+	cdc_atomic_commit_hw_done(commit);
+
+	/* Without a changed shadowed register there is nothing to latch. The
+	 * commit still completes with the next vblank. Direct MMIO does not
+	 * track changes.
+	 */
+	spin_lock_irqsave(&cdc->commit.lock, flags);
+	if (written == 0 && cdc->regcache.regs)
+		armed = cdc->hw.shadow_regs;
+	else
+		armed = cdc_hw_triggerShadowReload(cdc, true);
+	if (armed)
+		cdc->commit.armed = commit;
+	spin_unlock_irqrestore(&cdc->commit.lock, flags);
+
+	return armed;
+}
+
+static u32 cdc_crtc_vblank_line (struct cdc_device *cdc)
+{
+	return (cdc_read_reg(cdc, CDC_REG_GLOBAL_ACTIVE_WIDTH) & 0xffff) + 1;
+}
+
+/* Line of the latch deadline, counted back from the end of the active
+ * area. It never moves in front of the first active line.
+ */
+static u32 cdc_crtc_deadline_line (struct cdc_device *cdc, unsigned int lines)
+{
+	u32 first = (cdc_read_reg(cdc, CDC_REG_GLOBAL_BACK_PORCH) & 0xffff) + 1;
+	u32 vblank = cdc_crtc_vblank_line(cdc);
+
+	if (lines >= vblank - first)
+		return first;
+
+	return vblank - lines;
+}
+
+/* Moves the line IRQ to the latch deadline of the upcoming frame, if a
+ * deadline is set. Called from the vblank line IRQ.
+ */
+static void cdc_crtc_set_deadline (struct drm_crtc *crtc)
+{
+	struct cdc_device *cdc = to_cdc_dev(crtc);
+	unsigned long flags;
+	unsigned int lines;
+
+	spin_lock_irqsave(&cdc->commit.lock, flags);
+	lines = cdc->deadline.lines;
+	cdc->deadline.at_deadline = lines != 0;
+	spin_unlock_irqrestore(&cdc->commit.lock, flags);
+
+	if (lines)
+		cdc_write_reg(cdc, CDC_REG_GLOBAL_LINE_IRQ_POSITION,
+			cdc_crtc_deadline_line(cdc, lines));
+}
+
+/* With a latch deadline set, the line IRQ alternates between the deadline
+ * and the start of vblank. At the deadline the registers of the pending
+ * commit are written and the shadow reload is armed. A commit flushed
+ * before the deadline thus still makes the next frame, without the risk
+ * of its register writes racing the reload. Returns true if this was the
+ * deadline IRQ.
+ */
+static bool cdc_crtc_latch_irq (struct drm_crtc *crtc)
+{
+	struct cdc_device *cdc = to_cdc_dev(crtc);
+	struct cdc_commit *commit;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cdc->commit.lock, flags);
+	if (!cdc->deadline.at_deadline) {
+		spin_unlock_irqrestore(&cdc->commit.lock, flags);
+		return false;
+	}
+	cdc->deadline.at_deadline = false;
+	commit = cdc->deadline.pending;
+	cdc->deadline.pending = NULL;
+	spin_unlock_irqrestore(&cdc->commit.lock, flags);
+
+	cdc_write_reg(cdc, CDC_REG_GLOBAL_LINE_IRQ_POSITION,
+		cdc_crtc_vblank_line(cdc));
+
+	if (commit) {
+		trace_cdc_commit_latch(cdc, commit);
+		cdc_crtc_arm_commit(crtc, commit);
+	}
+
+	return true;
 }
 
 static bool cdc_crtc_page_flip_pending (struct drm_crtc *crtc)
@@ -136,13 +330,20 @@ static bool cdc_crtc_page_flip_pending (struct drm_crtc *crtc)
 	pending = cdc->event != NULL;
 	spin_unlock_irqrestore(&dev->event_lock, flags);
 
+	spin_lock_irqsave(&cdc->commit.lock, flags);
+	pending |= cdc->commit.armed != NULL;
+	pending |= cdc->deadline.pending != NULL;
+	spin_unlock_irqrestore(&cdc->commit.lock, flags);
+
 	return pending;
 }
 
-static void cdc_crtc_wait_page_flip (struct drm_crtc *crtc)
+void cdc_crtc_wait_page_flip (struct drm_crtc *crtc)
 {
 	struct drm_device *dev = crtc->dev;
 	struct cdc_device *cdc = dev->dev_private;
+	struct cdc_commit *commit;
+	unsigned long flags;
 
 	if (wait_event_timeout(cdc->flip_wait,
 			       !cdc_crtc_page_flip_pending(crtc),
@@ -150,13 +351,75 @@ static void cdc_crtc_wait_page_flip (struct drm_crtc *crtc)
 		return;
 
 	dev_warn(cdc->dev, "page flip timeout\n");
+	trace_cdc_flip_timeout(cdc);
+
+	spin_lock_irqsave(&cdc->commit.lock, flags);
+	commit = cdc->deadline.pending;
+	cdc->deadline.pending = NULL;
+	spin_unlock_irqrestore(&cdc->commit.lock, flags);
 
+	if (commit)
+		cdc_crtc_arm_commit(crtc, commit);
+
+	cdc_crtc_complete_commit(crtc, false);
 	cdc_crtc_finish_page_flip(crtc);
 }
 
+/* The gamma RAM is not shadowed. A new table is therefore written at the
+ * start of vblank, or right away while the CRTC is off.
+ */
+static void cdc_crtc_write_gamma (struct cdc_device *cdc)
+{
+	u32 *table = cdc->lut_upload.table;
+	unsigned long flags;
+	bool pending;
+	unsigned int i;
+
+	spin_lock_irqsave(&cdc->lut_upload.lock, flags);
+
+	spin_lock(&cdc->commit.lock);
+	pending = cdc->gamma.pending;
+	if (pending) {
+		memcpy(table, cdc->gamma.table, sizeof(cdc->gamma.table));
+		cdc->gamma.pending = false;
+	}
+	spin_unlock(&cdc->commit.lock);
+
+	if (pending)
+		for (i = 0; i < CDC_GAMMA_SIZE; ++i)
+			cdc_hw_setGammaEntry(cdc, i, table[i]);
+
+	spin_unlock_irqrestore(&cdc->lut_upload.lock, flags);
+}
+
+/* Converts a GAMMA_LUT blob, no blob means linear */
+static void cdc_crtc_load_gamma (struct drm_crtc *crtc,
+	struct drm_property_blob *blob)
+{
+	struct cdc_device *cdc = to_cdc_dev(crtc);
+	const struct drm_color_lut *lut = blob ? blob->data : NULL;
+	unsigned long flags;
+	unsigned int i;
+
+	spin_lock_irqsave(&cdc->commit.lock, flags);
+	for (i = 0; i < CDC_GAMMA_SIZE; ++i) {
+		if (lut)
+			cdc->gamma.table[i] = ((lut[i].red >> 8) << 16)
+				| ((lut[i].green >> 8) << 8) | (lut[i].blue >> 8);
+		else
+			cdc->gamma.table[i] = i * 0x010101;
+	}
+	cdc->gamma.pending = true;
+	spin_unlock_irqrestore(&cdc->commit.lock, flags);
+
+	if (!cdc->hw.enabled)
+		cdc_crtc_write_gamma(cdc);
+}
+
 void cdc_crtc_start (struct drm_crtc *crtc)
 {
 	struct cdc_device *cdc = to_cdc_dev(crtc);
+	unsigned long flags;
 
 	dev_dbg(cdc->dev, "%s\n", __func__);
 
@@ -164,10 +427,16 @@ void cdc_crtc_start (struct drm_crtc *crtc)
 		return;
 
 	cdc_hw_setEnabled(cdc, false);
-	cdc_hw_setBackgroundColor(cdc, 0xff0000ff);
+	cdc_hw_setBackgroundColor(cdc,
+		to_cdc_crtc_state(crtc->state)->background_color);
 
 	cdc_crtc_set_display_timing(crtc);
 
+	/* The timing resets the line IRQ to the start of vblank */
+	spin_lock_irqsave(&cdc->commit.lock, flags);
+	cdc->deadline.at_deadline = false;
+	spin_unlock_irqrestore(&cdc->commit.lock, flags);
+
 	drm_crtc_vblank_on(crtc);
 
 	cdc_hw_setEnabled(cdc, true);
@@ -246,6 +515,16 @@ static bool cdc_crtc_mode_fixup (struct drm_crtc *crtc,
 	return true;
 }
 
+static int cdc_crtc_atomic_check (struct drm_crtc *crtc,
+	struct drm_crtc_state *state)
+{
+	if (state->gamma_lut && (state->gamma_lut->length
+		!= CDC_GAMMA_SIZE * sizeof(struct drm_color_lut)))
+		return -EINVAL;
+
+	return 0;
+}
+
 static void cdc_crtc_atomic_begin (struct drm_crtc *crtc,
 	struct drm_crtc_state *old_crtc_state)
 {
@@ -256,6 +535,11 @@ static void cdc_crtc_atomic_begin (struct drm_crtc *crtc,
 
 	dev_dbg(cdc->dev, "%s (crtc: %p)\n", __func__, crtc);
 
+	/* Collect all plane register updates of this commit, they are
+	 * written in one go right before the shadow reload is triggered.
+	 */
+	cdc_hw_regcache_begin(cdc);
+
 	if (event) {
 		WARN_ON(drm_crtc_vblank_get(crtc) != 0);
 
@@ -269,38 +553,169 @@ static void cdc_crtc_atomic_flush (struct drm_crtc *crtc,
 	struct drm_crtc_state *old_crtc_state)
 {
 	struct cdc_device *cdc = to_cdc_dev(crtc);
+	struct cdc_crtc_state *cstate = to_cdc_crtc_state(crtc->state);
+	struct cdc_commit *commit = cdc->commit.active;
+	unsigned long flags;
+	bool deferred = false;
 
 	dev_dbg(cdc->dev, "%s (crtc: %p)\n", __func__, crtc);
 
 	dev_dbg(cdc->dev, "CRTC primary's crtc(crtc: %p)\n", crtc->primary->crtc);
 
-	if (cdc->wait_for_vblank) {
-		/* Schedule shadow reload for next vblank and wait for it.
-		 * We only have one CRTC, so index is 0.
+	spin_lock_irqsave(&cdc->commit.lock, flags);
+	cdc->deadline.lines = cstate->latch_deadline;
+	spin_unlock_irqrestore(&cdc->commit.lock, flags);
+
+	if (crtc->state->color_mgmt_changed)
+		cdc_crtc_load_gamma(crtc, crtc->state->gamma_lut);
+
+	/* Latched with the plane registers on the next shadow reload */
+	cdc_hw_setBackgroundColor(cdc, cstate->background_color);
+
+	if (commit)
+		trace_cdc_commit_flush(cdc, commit);
+
+	if (commit && drm_crtc_vblank_get(crtc) == 0) {
+		commit->target = drm_crtc_vblank_count(crtc) + 1;
+
+		/* With a latch deadline the registers stay in the cache, the
+		 * deadline line IRQ writes them. Otherwise schedule the shadow
+		 * reload for the next vblank right away. Either way the line
+		 * IRQ completes the commit once the reload has happened.
 		 */
-		cdc_hw_triggerShadowReload(cdc, true);
-		drm_wait_one_vblank(crtc->dev, 0);
+		spin_lock_irqsave(&cdc->commit.lock, flags);
+		if (cdc->deadline.lines && cdc->hw.shadow_regs) {
+			cdc->deadline.pending = commit;
+			deferred = true;
+		}
+		spin_unlock_irqrestore(&cdc->commit.lock, flags);
+
+		if (deferred || cdc_crtc_arm_commit(crtc, commit))
+			return;
+
+		/* No shadow registers, the update is already visible */
+		drm_crtc_vblank_put(crtc);
 	} else {
 		/* Reload immediately, since vblank is disabled */
+		cdc_hw_regcache_flush(cdc);
 		cdc_hw_triggerShadowReload(cdc, false);
+
+		if (commit)
+			commit->t_written = ktime_get();
 	}
+
+	/* The layer registers are visible now, switch the background layer */
+	cdc_hw_applyBackgroundLayer(cdc);
+
+	if (commit) {
+		commit->t_reload = commit->t_written;
+		cdc_crtc_finish_page_flip(crtc);
+		commit->t_event = ktime_get();
+		cdc_atomic_commit_done(commit);
+	}
+}
+
+static void cdc_crtc_reset (struct drm_crtc *crtc)
+{
+	struct cdc_crtc_state *state;
+
+	if (crtc->state)
+		__drm_atomic_helper_crtc_destroy_state(crtc->state);
+
+	kfree(crtc->state);
+	crtc->state = NULL;
+
+	state = kzalloc(sizeof(*state), GFP_KERNEL);
+	if (state == NULL)
+		return;
+
+	/* Blue, as programmed before BACKGROUND_COLOR existed */
+	state->background_color = CDC_CRTC_DEFAULT_BACKGROUND;
+
+	crtc->state = &state->state;
+	crtc->state->crtc = crtc;
+}
+
+static struct drm_crtc_state *
+	cdc_crtc_atomic_duplicate_state (struct drm_crtc *crtc)
+{
+	struct cdc_crtc_state *state = to_cdc_crtc_state(crtc->state);
+	struct cdc_crtc_state *copy;
+
+	copy = kzalloc(sizeof(*copy), GFP_KERNEL);
+	if (copy == NULL)
+		return NULL;
+
+	__drm_atomic_helper_crtc_duplicate_state(crtc, &copy->state);
+	copy->latch_deadline = state->latch_deadline;
+	copy->background_color = state->background_color;
+
+	return &copy->state;
+}
+
+static void cdc_crtc_atomic_destroy_state (struct drm_crtc *crtc,
+	struct drm_crtc_state *state)
+{
+	__drm_atomic_helper_crtc_destroy_state(state);
+	kfree(to_cdc_crtc_state(state));
+}
+
+static int cdc_crtc_atomic_set_property (struct drm_crtc *crtc,
+	struct drm_crtc_state *state, struct drm_property *property,
+	uint64_t val)
+{
+	struct cdc_crtc_state *cstate = to_cdc_crtc_state(state);
+	struct cdc_device *cdc = to_cdc_dev(crtc);
+
+	if (property == cdc->latch_deadline)
+		cstate->latch_deadline = val;
+	else if (property == cdc->background_color)
+		cstate->background_color = val;
+	else
+		return -EINVAL;
+
+	return 0;
+}
+
+static int cdc_crtc_atomic_get_property (struct drm_crtc *crtc,
+	const struct drm_crtc_state *state, struct drm_property *property,
+	uint64_t *val)
+{
+	const struct cdc_crtc_state
+	*cstate =
+		container_of(state, const struct cdc_crtc_state, state);
+	struct cdc_device *cdc = to_cdc_dev(crtc);
+
+	if (property == cdc->latch_deadline)
+		*val = cstate->latch_deadline;
+	else if (property == cdc->background_color)
+		*val = cstate->background_color;
+	else
+		return -EINVAL;
+
+	return 0;
 }
 
 static const struct drm_crtc_helper_funcs crtc_helper_funcs = {
 	.enable = cdc_crtc_enable,
 	.disable = cdc_crtc_disable,
 	.mode_fixup = cdc_crtc_mode_fixup,
+	.atomic_check = cdc_crtc_atomic_check,
 	.atomic_begin = cdc_crtc_atomic_begin,
 	.atomic_flush = cdc_crtc_atomic_flush,
 };
 
 static const struct drm_crtc_funcs crtc_funcs = {
-	.reset = drm_atomic_helper_crtc_reset,
+	.reset = cdc_crtc_reset,
 	.destroy = drm_crtc_cleanup,
 	.set_config = drm_atomic_helper_set_config,
 	.page_flip = drm_atomic_helper_page_flip,
-	.atomic_duplicate_state = drm_atomic_helper_crtc_duplicate_state,
-	.atomic_destroy_state = drm_atomic_helper_crtc_destroy_state,
+	.gamma_set = drm_atomic_helper_legacy_gamma_set,
+	.set_property = drm_atomic_helper_crtc_set_property,
+	.atomic_duplicate_state = cdc_crtc_atomic_duplicate_state,
+	.atomic_destroy_state = cdc_crtc_atomic_destroy_state,
+	.atomic_set_property = cdc_crtc_atomic_set_property,
+	.atomic_get_property = cdc_crtc_atomic_get_property,
 };
 
 void cdc_crtc_irq (struct drm_crtc *crtc)
@@ -308,8 +723,15 @@ void cdc_crtc_irq (struct drm_crtc *crtc)
 	unsigned long flags;
 	struct cdc_device *cdc = to_cdc_dev(crtc);
 
+	if (cdc_crtc_latch_irq(crtc))
+		return;
+
 	drm_crtc_handle_vblank(crtc);
-	cdc_crtc_finish_page_flip(crtc);
+	cdc_crtc_write_gamma(cdc);
+	cdc_planes_write_clut(cdc);
+	cdc_crc_frame_done(cdc, drm_crtc_vblank_count(crtc));
+	cdc_crtc_complete_commit(crtc, true);
+	cdc_crtc_set_deadline(crtc);
 
 	/* FIXME HACK for MesseDemo */
 	spin_lock_irqsave(&cdc->irq_slck, flags);
@@ -341,6 +763,33 @@ int cdc_crtc_create (struct cdc_device *cdc)
 
 	drm_crtc_helper_add(crtc, &crtc_helper_funcs);
 
+	cdc->latch_deadline = drm_property_create_range(cdc->ddev, 0,
+		"latch_deadline", 0, CDC_MAX_HEIGHT);
+	if (cdc->latch_deadline == NULL)
+		return -ENOMEM;
+
+	drm_object_attach_property(&crtc->base, cdc->latch_deadline, 0);
+
+	/* Shown wherever no layer covers the screen */
+	cdc->background_color = drm_property_create_range(cdc->ddev, 0,
+		"BACKGROUND_COLOR", 0, 0xffffff);
+	if (cdc->background_color == NULL)
+		return -ENOMEM;
+
+	if (cdc->hw.bg_color)
+		drm_object_attach_property(&crtc->base, cdc->background_color,
+			CDC_CRTC_DEFAULT_BACKGROUND);
+
+	if (cdc->hw.gamma) {
+		drm_crtc_enable_color_mgmt(crtc, 0, false, CDC_GAMMA_SIZE);
+		ret = drm_mode_crtc_set_gamma_size(crtc, CDC_GAMMA_SIZE);
+		if (ret < 0)
+			return ret;
+
+		/* Start out linear, the gamma RAM content is undefined */
+		cdc_crtc_load_gamma(crtc, NULL);
+	}
+
 	/* Start with vertical blanking interrupt reporting disabled. */
 	drm_crtc_vblank_off(crtc);
 
@@ -13,17 +13,40 @@
 #ifndef CDC_CRTC_H_
 #define CDC_CRTC_H_
 
+#include <drm/drm_crtc.h>
+
+#define CDC_CRTC_DEFAULT_BACKGROUND 0x0000ffu /* RGB888 blue */
+
+struct cdc_crtc_state {
+	struct drm_crtc_state state;
+
+	unsigned int latch_deadline; /* lines before end of active area */
+	u32 background_color; /* RGB888 */
+};
+
+static inline struct cdc_crtc_state
+*to_cdc_crtc_state(struct drm_crtc_state *state)
+{
+	return container_of(state, struct cdc_crtc_state, state);
+}
+
 int
 cdc_crtc_create (struct cdc_device *cdc);
 void
-cdc_crtc_start (struct cdc_device *cdc);
+cdc_crtc_start (struct drm_crtc *crtc);
 void
-cdc_crtc_stop (struct cdc_device *cdc);
+cdc_crtc_stop (struct drm_crtc *crtc);
 void
 cdc_crtc_set_vblank (struct cdc_device *cdc, bool enable);
 void
 cdc_crtc_irq (struct drm_crtc *crtc);
 void
 cdc_crtc_cancel_page_flip (struct drm_crtc *crtc, struct drm_file *file);
+void
+cdc_crtc_wait_page_flip (struct drm_crtc *crtc);
+int
+cdc_crtc_get_scanout_position (struct drm_crtc *crtc, unsigned int flags,
+	int *vpos, int *hpos, ktime_t *stime, ktime_t *etime,
+	const struct drm_display_mode *mode);
 
 #endif /* CDC_CRTC_H_ */
@@ -20,7 +20,11 @@
 #include <linux/slab.h>
 #include <linux/pm_runtime.h>
 #include <linux/clk.h>
+#include <linux/dma-mapping.h>
+#include <linux/dma-buf.h>
+#include <linux/file.h>
 
+#include <linux/debugfs.h>
 #include <linux/seq_file.h>
 
 #include <drm/drmP.h>
@@ -35,9 +39,17 @@
 #include "cdc_crtc.h"
 #include "cdc_hw.h"
 #include "cdc_hw_helpers.h"
+#include "cdc_sim.h"
+#include "cdc_crc.h"
+#include "cdc_trace.h"
+
+static bool sim;
+module_param(sim, bool, 0444);
+MODULE_PARM_DESC(sim, "Instantiate a simulated CDC (cdc-sim) device");
 
 static const struct platform_device_id cdc_id_table[] = {
 	{ "cdc", 0 },
+	{ "cdc-sim", 1 },
 	{ },
 };
 
@@ -45,6 +57,7 @@ MODULE_DEVICE_TABLE ( platform, cdc_id_table);
 
 static const struct of_device_id cdc_of_table[] = {
 	{ .compatible =	"tes,cdc-2.1", .data = NULL },
+	{ .compatible =	"tes,cdc-sim", .data = (void *) 1 },
 	{ },
 };
 
@@ -62,6 +75,16 @@ static void cdc_layer_init (struct cdc_device *cdc)
 		cdc->planes[i].hw_idx = i;
 		cdc->planes[i].cdc = cdc;
 		cdc->planes[i].used = false;
+
+		if (!cdc->hw.config_reading)
+			continue;
+
+		cdc->planes[i].config_1 = cdc_read_layer_reg(cdc, i,
+			CDC_REG_LAYER_CONFIG_1);
+		cdc->planes[i].config_2 = cdc_read_layer_reg(cdc, i,
+			CDC_REG_LAYER_CONFIG_2);
+		dev_dbg(cdc->dev, "Layer %d config: 0x%08x 0x%08x\n", i,
+			cdc->planes[i].config_1, cdc->planes[i].config_2);
 	}
 }
 
@@ -73,15 +96,22 @@ static irqreturn_t cdc_irq (int irq, void *arg)
 	status = cdc_read_reg(cdc, CDC_REG_GLOBAL_IRQ_STATUS);
 	cdc_write_reg(cdc, CDC_REG_GLOBAL_IRQ_CLEAR, status);
 
+	/* CRC errors are collected per frame while the capture runs */
+	if (cdc_crc_irq(cdc, status))
+		status &= ~CDC_IRQ_CRC_ERROR;
+
 	if (status & CDC_IRQ_LINE) {
+		trace_cdc_line_irq(cdc, status);
 		cdc_crtc_irq(&cdc->crtc);
 	}
 	if (status & CDC_IRQ_BUS_ERROR) {
+		trace_cdc_bus_error(cdc);
 		dev_err_ratelimited(cdc->dev, "BUS error IRQ triggered\n");
 	}
 	if (status & CDC_IRQ_FIFO_UNDERRUN_WARN) {
 		// disable underrun IRQ to prevent IRQ flooding
 		cdc_irq_set(cdc, CDC_IRQ_FIFO_UNDERRUN_WARN, false);
+		trace_cdc_fifo_underrun_warn(cdc);
 
 		dev_err_ratelimited(cdc->dev, "FIFO underrun warn\n");
 	}
@@ -94,6 +124,7 @@ static irqreturn_t cdc_irq (int irq, void *arg)
 	if (status & CDC_IRQ_FIFO_UNDERRUN) {
 		// disable underrun IRQ to prevent IRQ flooding
 		cdc_irq_set(cdc, CDC_IRQ_FIFO_UNDERRUN, false);
+		trace_cdc_fifo_underrun(cdc);
 
 		dev_err_ratelimited(cdc->dev, "FIFO underrun\n");
 	}
@@ -114,6 +145,14 @@ bool cdc_init_irq (struct cdc_device *cdc)
 	int irq;
 	int ret;
 
+	if (cdc->sim) {
+		cdc_write_reg(cdc, CDC_REG_GLOBAL_IRQ_ENABLE,
+			cdc->hw.irq_enabled);
+		cdc_write_reg(cdc, CDC_REG_GLOBAL_IRQ_CLEAR, 0xff);
+		cdc_sim_set_irq_handler(cdc->sim, cdc_irq, cdc);
+		return true;
+	}
+
 	irq = platform_get_irq(pdev, 0);
 	if (irq < 0) {
 		dev_err(cdc->dev, "Could not get platform IRQ number\n");
@@ -154,6 +193,26 @@ static void cdc_disable_vblank (struct drm_device *dev, unsigned int pipe)
 	cdc_crtc_set_vblank(cdc, false);
 }
 
+static int cdc_get_scanout_position (struct drm_device *dev, unsigned int pipe,
+	unsigned int flags, int *vpos, int *hpos, ktime_t *stime,
+	ktime_t *etime, const struct drm_display_mode *mode)
+{
+	struct cdc_device *cdc = dev->dev_private;
+
+	return cdc_crtc_get_scanout_position(&cdc->crtc, flags, vpos, hpos,
+		stime, etime, mode);
+}
+
+static int cdc_get_vblank_timestamp (struct drm_device *dev,
+	unsigned int pipe, int *max_error, struct timeval *vblank_time,
+	unsigned flags)
+{
+	struct cdc_device *cdc = dev->dev_private;
+
+	return drm_calc_vbltimestamp_from_scanoutpos(dev, pipe, max_error,
+		vblank_time, flags, &cdc->crtc.hwmode);
+}
+
 /* TODO: remove when cdc is fixed
  * Enforcing 256 byte pitch
  * */
@@ -179,7 +238,7 @@ static int cdc_regs_show(struct seq_file *m, void *arg)
 	/* Show the first few registers */
 	for(i=0; i<(CDC_LAYER_SPAN + CDC_LAYER_SPAN * cdc->hw.layer_count); i += 4)
 	{
-		u32 reg = cdc_read_reg(cdc, i);
+		u32 reg = cdc_read_reg_uncached(cdc, i);
 
 		if(i == 0)
 			seq_printf(m, "Global:\n");
@@ -187,11 +246,11 @@ static int cdc_regs_show(struct seq_file *m, void *arg)
 			seq_printf(m, "Layer %d:\n", i / CDC_LAYER_SPAN);
 
 		seq_printf(m, "%03x: %08x", i * 4, reg);
-		reg = cdc_read_reg(cdc, i+1);
+		reg = cdc_read_reg_uncached(cdc, i+1);
 		seq_printf(m, " %08x", reg);
-		reg = cdc_read_reg(cdc, i+2);
+		reg = cdc_read_reg_uncached(cdc, i+2);
 		seq_printf(m, " %08x", reg);
-		reg = cdc_read_reg(cdc, i+3);
+		reg = cdc_read_reg_uncached(cdc, i+3);
 		seq_printf(m, " %08x\n", reg);
 	}
 
@@ -200,41 +259,117 @@ static int cdc_regs_show(struct seq_file *m, void *arg)
 	return 0;
 }
 
-static int cdc_dump_fb(struct seq_file *m, void *arg)
+static int cdc_regcache_show(struct seq_file *m, void *arg)
 {
 	struct drm_info_node *node = (struct drm_info_node *) m->private;
 	struct drm_device *dev = node->minor->dev;
-	struct drm_framebuffer *fb;
-	int ret;
-	int i = 0;
+	struct cdc_device *cdc = dev->dev_private;
+	unsigned int last_written, last_coalesced;
+	unsigned long flags;
+	u64 flushes;
+
+	spin_lock_irqsave(&cdc->regcache.lock, flags);
+	last_written = cdc->regcache.last_written;
+	last_coalesced = cdc->regcache.last_coalesced;
+	flushes = cdc->regcache.flushes;
+	spin_unlock_irqrestore(&cdc->regcache.lock, flags);
+
+	seq_printf(m, "cached registers: %u\n", cdc->regcache.size);
+	seq_printf(m, "mmio reads:       %lld\n",
+		atomic64_read(&cdc->regcache.mmio_reads));
+	seq_printf(m, "cache hits:       %lld\n",
+		atomic64_read(&cdc->regcache.hits));
+	seq_printf(m, "mmio writes:      %lld\n",
+		atomic64_read(&cdc->regcache.mmio_writes));
+	seq_printf(m, "coalesced writes: %lld\n",
+		atomic64_read(&cdc->regcache.coalesced));
+	seq_printf(m, "flushed commits:  %llu\n", flushes);
+	seq_printf(m, "last commit:      %u written, %u coalesced\n",
+		last_written, last_coalesced);
 
-	ret = mutex_lock_interruptible(&dev->mode_config.mutex);
-	if(ret)
-		return ret;
+	return 0;
+}
 
-	ret = mutex_lock_interruptible(&dev->struct_mutex);
-	if(ret) {
-		mutex_unlock(&dev->mode_config.mutex);
-		return ret;
-	}
+static int cdc_commits_show(struct seq_file *m, void *arg)
+{
+	struct drm_info_node *node = (struct drm_info_node *) m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct cdc_device *cdc = dev->dev_private;
+	unsigned long flags;
+	typeof(cdc->commit.stats) stats;
 
-	list_for_each_entry(fb, &dev->mode_config.fb_list, head)
-	{
-		struct drm_gem_cma_object *obj = drm_fb_cma_get_gem_obj(fb, 0);
+	spin_lock_irqsave(&cdc->commit.lock, flags);
+	stats = cdc->commit.stats;
+	spin_unlock_irqrestore(&cdc->commit.lock, flags);
 
-		if(i==1)
-		{
-			seq_write(m, obj->vaddr, 800*600*4); /* FIXME: static size, bad hack! */
-		}
-		++i;
-	}
+	seq_printf(m, "nonblocking commits: %llu\n", stats.count);
+	seq_printf(m, "worker latency:      %lld us (max %lld us)\n",
+		stats.last_latency_us, stats.max_latency_us);
+	seq_printf(m, "worker duration:     %lld us (max %lld us)\n",
+		stats.last_duration_us, stats.max_duration_us);
+	seq_printf(m, "made target frame:   %llu\n", stats.made);
+	seq_printf(m, "missed target frame: %llu\n", stats.missed);
 
-	mutex_unlock(&dev->struct_mutex);
-	mutex_unlock(&dev->mode_config.mutex);
+	return 0;
+}
+
+static int cdc_latency_show(struct seq_file *m, void *arg)
+{
+	static const char * const stages[CDC_LATENCY_COUNT] = {
+		[CDC_LATENCY_COMMIT_SWAP] = "commit-swap",
+		[CDC_LATENCY_SWAP_WRITE] = "swap-write",
+		[CDC_LATENCY_WRITE_RELOAD] = "write-reload",
+		[CDC_LATENCY_RELOAD_EVENT] = "reload-event",
+	};
+	struct drm_info_node *node = (struct drm_info_node *) m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct cdc_device *cdc = dev->dev_private;
+	struct cdc_latency latency[CDC_LATENCY_COUNT];
+	unsigned long flags;
+	int i, j;
+
+	spin_lock_irqsave(&cdc->commit.lock, flags);
+	memcpy(latency, cdc->commit.latency, sizeof(latency));
+	spin_unlock_irqrestore(&cdc->commit.lock, flags);
+
+	seq_printf(m, "%-12s", "< us");
+	for (j = 0; j < CDC_LATENCY_COUNT; ++j)
+		seq_printf(m, " %12s", stages[j]);
+	seq_puts(m, "\n");
+
+	for (i = 0; i < CDC_LATENCY_BUCKETS; ++i) {
+		seq_printf(m, "%-12lu", 1ul << i);
+		for (j = 0; j < CDC_LATENCY_COUNT; ++j)
+			seq_printf(m, " %12u", latency[j].bucket[i]);
+		seq_puts(m, "\n");
+	}
 
 	return 0;
 }
 
+/* Any write to latency_reset clears the histograms. The counters in the
+ * commits file keep running.
+ */
+static ssize_t cdc_latency_reset_write(struct file *file,
+	const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct cdc_device *cdc = file->private_data;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cdc->commit.lock, flags);
+	memset(cdc->commit.latency, 0, sizeof(cdc->commit.latency));
+	spin_unlock_irqrestore(&cdc->commit.lock, flags);
+
+	return count;
+}
+
+static const struct file_operations cdc_latency_reset_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.write = cdc_latency_reset_write,
+	.llseek = no_llseek,
+};
+
 static int cdc_mm_show(struct seq_file *m, void *arg)
 {
 	struct drm_info_node *node = (struct drm_info_node *) m->private;
@@ -244,14 +379,17 @@ static int cdc_mm_show(struct seq_file *m, void *arg)
 
 static struct drm_info_list cdc_debugfs_list[] = {
 	{ "regs", cdc_regs_show, 0 },
+	{ "regcache", cdc_regcache_show, 0 },
+	{ "commits", cdc_commits_show, 0 },
+	{ "latency", cdc_latency_show, 0 },
 	{ "mm", cdc_mm_show, 0 },
 	{ "fb", drm_fb_cma_debugfs_show, 0 },
-	{ "fbdump", cdc_dump_fb, 0 },
 };
 
 static int cdc_debugfs_init(struct drm_minor *minor)
 {
 	struct drm_device *dev = minor->dev;
+	struct cdc_device *cdc = dev->dev_private;
 	int ret;
 
 	ret = drm_debugfs_create_files(cdc_debugfs_list,
@@ -263,11 +401,27 @@ static int cdc_debugfs_init(struct drm_minor *minor)
 		return ret;
 	}
 
+	/* drm_info_list files are read-only */
+	cdc->debugfs_latency_reset = debugfs_create_file("latency_reset",
+		S_IWUSR, minor->debugfs_root, cdc, &cdc_latency_reset_fops);
+	if (cdc->debugfs_latency_reset == NULL)
+		dev_warn(dev->dev, "could not create latency_reset debugfs file\n");
+
+	if (cdc_crc_debugfs_init(cdc, minor->debugfs_root) < 0)
+		dev_warn(dev->dev, "could not create crc debugfs files\n");
+
 	return ret;
 }
 
 static void cdc_debugfs_cleanup(struct drm_minor *minor)
 {
+	struct cdc_device *cdc = minor->dev->dev_private;
+
+	debugfs_remove(cdc->debugfs_latency_reset);
+	cdc->debugfs_latency_reset = NULL;
+
+	cdc_crc_debugfs_cleanup(cdc);
+
 	drm_debugfs_remove_files(cdc_debugfs_list,
 		ARRAY_SIZE(cdc_debugfs_list), minor);
 }
@@ -275,6 +429,83 @@ static void cdc_debugfs_cleanup(struct drm_minor *minor)
 
 #include "cdc_ioctl.h"
 
+/* Exports the buffer shown by a plane as a dma-buf. The fd is only
+ * installed once the reply reached user space, a failed copy must not
+ * leave a descriptor behind that the caller never learns about.
+ */
+static int cdc_ioctl_capture (struct drm_file *file_priv,
+	struct cdc_device *cdc, struct hack_capture *cap,
+	struct hack_capture __user *arg)
+{
+	struct drm_device *dev = cdc->ddev;
+	struct drm_plane *plane;
+	struct drm_plane_state *state;
+	struct drm_gem_cma_object *gem = NULL;
+	struct dma_buf *dmabuf;
+	int fd;
+
+	/* Other clients' buffers, like the root-only fbdump it replaces */
+	if (!drm_is_current_master(file_priv) && !capable(CAP_SYS_ADMIN))
+		return -EACCES;
+
+	if (cap->plane >= 0 && cap->plane < cdc->hw.layer_count)
+		plane = &cdc->planes[cap->plane].plane;
+	else if (cap->plane == cdc->hw.layer_count && cdc->hw.bg_layer)
+		plane = &cdc->bg_plane.plane;
+	else
+		return -EINVAL;
+
+	/* Only hold the plane lock while looking up the buffer, the export
+	 * itself works on a reference of the GEM object.
+	 */
+	drm_modeset_lock(&plane->mutex, NULL);
+	state = plane->state;
+	if (state->fb && state->crtc) {
+		gem = drm_fb_cma_get_gem_obj(state->fb, 0);
+		drm_gem_object_reference(&gem->base);
+
+		cap->fourcc = state->fb->pixel_format;
+		cap->width = state->fb->width;
+		cap->height = state->fb->height;
+		cap->pitch = state->fb->pitches[0];
+		cap->offset = state->fb->offsets[0];
+		cap->src_x = state->src_x >> 16;
+		cap->src_y = state->src_y >> 16;
+		cap->src_w = state->src_w >> 16;
+		cap->src_h = state->src_h >> 16;
+	}
+	drm_modeset_unlock(&plane->mutex);
+
+	if (gem == NULL)
+		return -ENOENT;
+
+	cap->size = gem->base.size;
+
+	/* The dma-buf takes over the GEM reference and drops it on release */
+	dmabuf = dev->driver->gem_prime_export(dev, &gem->base, O_RDONLY);
+	if (IS_ERR(dmabuf)) {
+		drm_gem_object_unreference_unlocked(&gem->base);
+		return PTR_ERR(dmabuf);
+	}
+
+	fd = get_unused_fd_flags(O_CLOEXEC);
+	if (fd < 0) {
+		dma_buf_put(dmabuf);
+		return fd;
+	}
+
+	cap->fd = fd;
+	if (copy_to_user(arg, cap, sizeof(*cap)) != 0) {
+		put_unused_fd(fd);
+		dma_buf_put(dmabuf);
+		return -EFAULT;
+	}
+
+	fd_install(fd, dmabuf->file);
+
+	return 0;
+}
+
 long cdc_ioctl (struct file *filp, unsigned int cmd, unsigned long arg)
 {
 	struct drm_file *file_priv = filp->private_data;
@@ -283,6 +514,7 @@ long cdc_ioctl (struct file *filp, unsigned int cmd, unsigned long arg)
 	char stack_data[128];
 	unsigned int nr = HACK_IOCTL_NR(cmd);
 	unsigned int size;
+	int ret = 0;
 
 	dev = file_priv->minor->dev;
 	cdc = dev->dev_private;
@@ -290,6 +522,9 @@ long cdc_ioctl (struct file *filp, unsigned int cmd, unsigned long arg)
 	if (nr >= 0xe0) {
 		size = _IOC_SIZE(cmd);
 
+		if (size > sizeof(stack_data))
+			return -EINVAL;
+
 		if (cmd & IOC_IN) {
 			if (copy_from_user(stack_data, (void __user *) arg, size) != 0) {
 				return -EFAULT;
@@ -347,10 +582,29 @@ long cdc_ioctl (struct file *filp, unsigned int cmd, unsigned long arg)
 			break;
 		}
 
+		case 0xe4:
+			/* Anything smaller leaves stack_data uninitialized */
+			if (cmd != HACK_IOCTL_CAPTURE)
+				return -EINVAL;
+
+			/* Copies its reply itself, see cdc_ioctl_capture() */
+			return cdc_ioctl_capture(file_priv, cdc,
+				(struct hack_capture *) stack_data,
+				(struct hack_capture __user *) arg);
+
 		default:
 			printk(KERN_ERR "Unknown IOCTL (nr = %u)!\n", nr);
 		}
 
+		if (ret < 0)
+			return ret;
+
+		if (cmd & IOC_OUT) {
+			if (copy_to_user((void __user *) arg, stack_data, size) != 0) {
+				return -EFAULT;
+			}
+		}
+
 		return 0;
 	}
 
@@ -377,6 +631,8 @@ static struct drm_driver cdc_driver = {
 	.get_vblank_counter = drm_vblank_no_hw_counter,
 	.enable_vblank = cdc_enable_vblank,
 	.disable_vblank = cdc_disable_vblank,
+	.get_scanout_position = cdc_get_scanout_position,
+	.get_vblank_timestamp = cdc_get_vblank_timestamp,
 	.gem_free_object = drm_gem_cma_free_object,
 	.prime_handle_to_fd = drm_gem_prime_handle_to_fd,
 	.prime_fd_to_handle = drm_gem_prime_fd_to_handle,
@@ -448,16 +704,29 @@ static int cdc_remove (struct platform_device *pdev)
 		drm_fbdev_cma_fini(cdc->fbdev);
 
 	drm_kms_helper_poll_fini(ddev);
+	cdc_modeset_fini(cdc);
 	drm_mode_config_cleanup(ddev);
 
 	cdc_write_reg(cdc, CDC_REG_GLOBAL_IRQ_ENABLE, 0x0);
 	cdc_hw_setEnabled(cdc, false);
 
+	cdc_sim_fini(cdc);
+
 	drm_dev_unref(ddev);
 
 	return 0;
 }
 
+static bool cdc_is_sim (struct platform_device *pdev)
+{
+	const struct platform_device_id *id = platform_get_device_id(pdev);
+
+	if (pdev->dev.of_node)
+		return of_device_get_match_data(&pdev->dev) != NULL;
+
+	return id && id->driver_data;
+}
+
 static int cdc_probe (struct platform_device *pdev)
 {
 	struct device_node *np = pdev->dev.of_node;
@@ -466,7 +735,7 @@ static int cdc_probe (struct platform_device *pdev)
 	struct resource *mem;
 	int ret = 0;
 
-	if (np == NULL) {
+	if (np == NULL && !cdc_is_sim(pdev)) {
 		dev_err(&pdev->dev, "no platform data\n");
 		return -ENODEV;
 	}
@@ -478,6 +747,9 @@ static int cdc_probe (struct platform_device *pdev)
 	}
 
 	init_waitqueue_head(&cdc->commit.wait);
+	spin_lock_init(&cdc->commit.lock);
+	INIT_LIST_HEAD(&cdc->commit.queue);
+	spin_lock_init(&cdc->lut_upload.lock);
 
 	/* FIXME HACK for MesseDemo   */
 	spin_lock_init(&cdc->irq_slck);
@@ -487,21 +759,36 @@ static int cdc_probe (struct platform_device *pdev)
 
 	platform_set_drvdata(pdev, cdc);
 
-	cdc->pclk = devm_clk_get(&pdev->dev, NULL);
-	if (IS_ERR(cdc->pclk)) {
-		dev_err(&pdev->dev, "failed to initialize pixel clock\n");
-		return PTR_ERR(cdc->pclk);
-	}
+	if (cdc_is_sim(pdev)) {
+		/* No pixel clock and no register window, the model
+		 * provides both. Buffers come from the default CMA pool.
+		 */
+		ret = cdc_sim_init(cdc);
+		if (ret < 0)
+			return ret;
+
+		ret = dma_coerce_mask_and_coherent(&pdev->dev,
+			DMA_BIT_MASK(32));
+		if (ret < 0)
+			return ret;
+	} else {
+		cdc->pclk = devm_clk_get(&pdev->dev, NULL);
+		if (IS_ERR(cdc->pclk)) {
+			dev_err(&pdev->dev,
+				"failed to initialize pixel clock\n");
+			return PTR_ERR(cdc->pclk);
+		}
 
-	mem = platform_get_resource(pdev, IORESOURCE_MEM, 0);
-	cdc->mmio = devm_ioremap_resource(&pdev->dev, mem);
-	dev_dbg(&pdev->dev, "Mapped IO from 0x%x to 0x%p\n", mem->start,
-		cdc->mmio);
-	if (IS_ERR(cdc->mmio)) {
-		return PTR_ERR(cdc->mmio);
+		mem = platform_get_resource(pdev, IORESOURCE_MEM, 0);
+		cdc->mmio = devm_ioremap_resource(&pdev->dev, mem);
+		dev_dbg(&pdev->dev, "Mapped IO from 0x%x to 0x%p\n",
+			mem->start, cdc->mmio);
+		if (IS_ERR(cdc->mmio)) {
+			return PTR_ERR(cdc->mmio);
+		}
 	}
 
-	np = of_parse_phandle(pdev->dev.of_node, "memory-region", 0);
+	np = np ? of_parse_phandle(np, "memory-region", 0) : NULL;
 	if (np) {
 		dev_err(&pdev->dev, "Using reserved memory as CMA pool\n");
 		ret = of_reserved_mem_device_init(&pdev->dev);
@@ -540,7 +827,11 @@ static int cdc_probe (struct platform_device *pdev)
 
 		cdc->hw.layer_count = layer_count;
 		cdc->hw.shadow_regs = conf1.bits.m_shadow_regs;
+		cdc->hw.gamma = conf1.bits.m_gamma != 0;
+		cdc->hw.bg_color = conf1.bits.m_bg_color;
+		cdc->hw.config_reading = conf1.bits.m_config_reading;
 		cdc->hw.bus_width = 1 << conf2.bits.m_bus_width;
+		cdc->hw.bg_layer = conf2.bits.m_bg_layer;
 
 		dev_info(&pdev->dev, "CDC HW ver. %u.%u (rev. %u):\n",
 			 hwrev.bits.m_major, hwrev.bits.m_minor,
@@ -549,6 +840,20 @@ static int cdc_probe (struct platform_device *pdev)
 		dev_info(&pdev->dev, "\tbus width: %u byte\n", cdc->hw.bus_width);
 	}
 
+	/* Memory bandwidth available for layer fetches, see
+	 * cdc_atomic_check_bandwidth()
+	 */
+	if (pdev->dev.of_node && of_property_read_u32(pdev->dev.of_node,
+			"tes,max-bandwidth", &cdc->hw.max_bandwidth) == 0)
+		dev_info(&pdev->dev, "\tbandwidth budget: %u kB/s\n",
+			cdc->hw.max_bandwidth);
+
+	if (cdc_hw_regcache_init(cdc) < 0)
+		dev_warn(&pdev->dev, "no register cache, using direct MMIO\n");
+
+	if (cdc_crc_init(cdc) < 0)
+		dev_warn(&pdev->dev, "no CRC capture\n");
+
 	cdc_layer_init(cdc);
 
 	cdc_hw_resetRegisters(cdc);
@@ -593,7 +898,35 @@ static struct platform_driver cdc_platform_driver = {
 	.id_table = cdc_id_table,
 };
 
-module_platform_driver (cdc_platform_driver);
+static struct platform_device *cdc_sim_pdev;
+
+static int __init cdc_init (void)
+{
+	int ret;
+
+	ret = platform_driver_register(&cdc_platform_driver);
+	if (ret < 0 || !sim)
+		return ret;
+
+	cdc_sim_pdev = platform_device_register_simple("cdc-sim", -1, NULL, 0);
+	if (IS_ERR(cdc_sim_pdev)) {
+		platform_driver_unregister(&cdc_platform_driver);
+		return PTR_ERR(cdc_sim_pdev);
+	}
+
+	return 0;
+}
+
+static void __exit cdc_exit (void)
+{
+	if (!IS_ERR_OR_NULL(cdc_sim_pdev))
+		platform_device_unregister(cdc_sim_pdev);
+
+	platform_driver_unregister(&cdc_platform_driver);
+}
+
+module_init(cdc_init);
+module_exit(cdc_exit);
 
 MODULE_AUTHOR("Christian Thaler <christian.thaler@tes-dst.com>");
 MODULE_DESCRIPTION("TES CDC Display Controller DRM Driver");
@@ -22,12 +22,34 @@
 #define CDC_MAX_HEIGHT 2047u
 #define CDC_MAX_PITCH  8192u
 #define CDC_OFFSET_LAYER 0x40
+#define CDC_GAMMA_SIZE 256u
+/* DRM plane masks are 32 bit, one plane is the background layer */
+#define CDC_MAX_LAYERS 31u
+
+/* Commit latency histograms, bucket n counts latencies below 2^n us */
+#define CDC_LATENCY_BUCKETS 24
+
+enum cdc_latency_stage {
+	CDC_LATENCY_COMMIT_SWAP,  /* checked commit until state swap */
+	CDC_LATENCY_SWAP_WRITE,   /* state swap until registers written */
+	CDC_LATENCY_WRITE_RELOAD, /* registers written until shadow reload */
+	CDC_LATENCY_RELOAD_EVENT, /* shadow reload until event sent */
+	CDC_LATENCY_COUNT
+};
+
+struct cdc_latency {
+	u32 bucket[CDC_LATENCY_BUCKETS];
+};
 
 struct cdc_device;
 struct cdc_format;
+struct cdc_commit;
 struct drm_pending_vblank_event;
 struct drm_fbdev_cma;
 struct altera_pll;
+struct cdc_sim;
+struct cdc_crc;
+struct kthread_worker;
 
 struct cdc_plane {
 	struct drm_plane plane;
@@ -35,11 +57,18 @@ struct cdc_plane {
 	int hw_idx;
 	bool enabled;
 	bool used;
+	u32 config_1; /* layer capabilities, 0 if not readable */
+	u32 config_2;
+	bool clut_loaded;
+	u32 *clut; /* palette for the next vblank, NULL with a scaler */
+	bool clut_pending; /* protected by commit.lock */
 
 	u8 pixel_format;
 	u16 fb_width;
 	u16 fb_height;
 	s32 fb_pitch;
+	u32 aux_fb_control;
+	s32 aux_fb_pitch;
 	u16 window_width;
 	u16 window_height;
 	u16 window_x;
@@ -54,21 +83,51 @@ struct cdc_device {
 	struct drm_device *ddev;
 
 	void __iomem *mmio;
+	struct cdc_sim *sim; /* register model replacing mmio, see cdc_sim.c */
+	struct cdc_crc *crc; /* per-frame CRC capture, see cdc_crc.c */
 
 	/* HW context */
 	struct {
 		int layer_count;
 		bool enabled;
 		bool shadow_regs;
+		bool gamma; /* gamma correction unit present */
+		bool bg_color; /* background color programmable */
+		bool bg_layer; /* background layer present */
+		bool bg_layer_enabled; /* switched on the next shadow reload */
+		bool config_reading; /* layer CONFIG registers are readable */
 		u32 irq_enabled;
 		u32 bus_width; /* bus width in bytes */
+		u32 max_bandwidth; /* fetch budget in kB/s, 0 = unlimited */
 	} hw;
 
+	/* In-memory copy of the register file, see cdc_hw.c */
+	struct {
+		u32 *regs;
+		unsigned long *valid;
+		u64 *dirty; /* one bitmap per register block */
+		unsigned int size; /* in words */
+		bool deferred;
+		unsigned int unlatched; /* shadowed, written outside a commit */
+		unsigned int unflushed_coalesced; /* since the last flush */
+		/* last flush, i.e. the registers of the last commit */
+		unsigned int last_written;
+		unsigned int last_coalesced;
+		u64 flushes;
+		spinlock_t lock;
+		atomic64_t mmio_reads;
+		atomic64_t mmio_writes;
+		atomic64_t hits;
+		atomic64_t coalesced;
+	} regcache;
+
 	struct clk *pclk;
 	struct drm_pending_vblank_event *event;
 	wait_queue_head_t flip_wait;
+	struct dentry *debugfs_latency_reset;
 	struct drm_fbdev_cma *fbdev;
 	struct cdc_plane *planes;
+	struct cdc_plane bg_plane; /* below all layers, see hw.bg_layer */
 
 	int dpms;
 	bool wait_for_vblank;
@@ -81,12 +140,64 @@ struct cdc_device {
 
 	// plane properties
 	struct drm_property *alpha;
+	struct drm_property *color_encoding;
+	struct drm_property *color_range;
+	struct drm_property *palette;
+	struct drm_property *pixel_source;
+	struct drm_property *fill_color;
+	struct drm_property *colorkey;
+	struct drm_property *colorkey_mode;
+	struct drm_property *alpha_fb;
+
+	// crtc properties
+	struct drm_property *latch_deadline;
+	struct drm_property *background_color;
 
 	struct {
 		wait_queue_head_t wait;
-		u32 pending;
+		spinlock_t lock;
+		struct list_head queue; /* in-flight commits, oldest first */
+		struct cdc_commit *active; /* commit being written to the HW */
+		struct cdc_commit *armed;  /* commit waiting for shadow reload */
+		struct kthread_worker *worker; /* runs nonblocking commits */
+		struct {
+			u64 count;
+			s64 last_latency_us; /* queued until worker started */
+			s64 max_latency_us;
+			s64 last_duration_us; /* worker start until done */
+			s64 max_duration_us;
+			u64 made; /* on screen at the targeted vblank */
+			u64 missed;
+		} stats;
+		struct cdc_latency latency[CDC_LATENCY_COUNT];
 	} commit;
 
+	/* Late latching of commits, see cdc_crtc_latch_irq(). Protected by
+	 * commit.lock.
+	 */
+	struct {
+		unsigned int lines; /* before end of active area, 0 = off */
+		bool at_deadline; /* line IRQ is programmed to the deadline */
+		struct cdc_commit *pending; /* registers still in the cache */
+	} deadline;
+
+	/* Gamma RAM content, written at the next vblank if pending. Protected
+	 * by commit.lock.
+	 */
+	struct {
+		u32 table[CDC_GAMMA_SIZE];
+		bool pending;
+	} gamma;
+
+	/* Copy of a pending gamma table or palette while it is written to the
+	 * hardware, so commit.lock is not held across the MMIO writes. lock
+	 * serializes the uploads.
+	 */
+	struct {
+		spinlock_t lock;
+		u32 table[CDC_GAMMA_SIZE];
+	} lut_upload;
+
 	/* FIXME HACK for MesseDemo */
 	unsigned int irq_stat;
 	spinlock_t irq_slck;
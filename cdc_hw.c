@@ -14,15 +14,214 @@
 #include "cdc_drv.h"
 #include "cdc_crtc.h"
 #include "cdc_regs.h"
+#include "cdc_hw.h"
+#include "cdc_sim.h"
 
-u32 cdc_read_reg (struct cdc_device *cdc, u32 reg)
+static u32 read_reg (struct cdc_device *cdc, u32 reg)
 {
+	atomic64_inc(&cdc->regcache.mmio_reads);
+	if (cdc->sim)
+		return cdc_sim_read_reg(cdc->sim, reg);
 	return ioread32(cdc->mmio + (reg * 4));
 }
 
+static void write_reg (struct cdc_device *cdc, u32 reg, u32 val)
+{
+	atomic64_inc(&cdc->regcache.mmio_writes);
+	if (cdc->sim)
+		cdc_sim_write_reg(cdc->sim, reg, val);
+	else
+		iowrite32(val, cdc->mmio + (reg * 4));
+}
+
+/* Registers that are changed by the hardware itself or that have side
+ * effects on access. These always go to the bus.
+ */
+static bool reg_is_volatile (u32 reg)
+{
+	if (reg >= CDC_LAYER_SPAN)
+		return (reg % CDC_LAYER_SPAN) == CDC_REG_LAYER_RELOAD;
+
+	switch (reg) {
+	case CDC_REG_GLOBAL_SHADOW_RELOAD:
+	case CDC_REG_GLOBAL_GAMMA:
+	case CDC_REG_GLOBAL_IRQ_STATUS:
+	case CDC_REG_GLOBAL_IRQ_CLEAR:
+	case CDC_REG_GLOBAL_POSITION:
+	case CDC_REG_GLOBAL_SYNC_STATUS:
+	case CDC_REG_GLOBAL_BG_LAYER_ADDR:
+	case CDC_REG_GLOBAL_BG_LAYER_DATA:
+	case CDC_REG_GLOBAL_SLAVE_TIMING_STATUS:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Registers that only take effect on the next shadow reload and can thus be
+ * batched until the commit is flushed.
+ */
+static bool reg_is_deferrable (u32 reg)
+{
+	if (reg >= CDC_LAYER_SPAN)
+		return (reg % CDC_LAYER_SPAN) > CDC_REG_LAYER_RELOAD;
+
+	switch (reg) {
+	case CDC_REG_GLOBAL_BG_COLOR:
+	case CDC_REG_GLOBAL_BG_LAYER_BASE:
+	case CDC_REG_GLOBAL_BG_LAYER_INC:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool reg_is_cached (struct cdc_device *cdc, u32 reg)
+{
+	return cdc->regcache.regs && (reg < cdc->regcache.size)
+		&& !reg_is_volatile(reg);
+}
+
+int cdc_hw_regcache_init (struct cdc_device *cdc)
+{
+	unsigned int blocks = cdc->hw.layer_count + 1;
+	unsigned int size = CDC_LAYER_SPAN * blocks;
+
+	/* one dirty word per register block */
+	BUILD_BUG_ON(CDC_LAYER_SPAN != 64);
+
+	spin_lock_init(&cdc->regcache.lock);
+
+	cdc->regcache.dirty = devm_kcalloc(cdc->dev, blocks, sizeof(u64),
+		GFP_KERNEL);
+
+	cdc->regcache.valid = devm_kcalloc(cdc->dev, BITS_TO_LONGS(size),
+		sizeof(unsigned long), GFP_KERNEL);
+	cdc->regcache.regs = devm_kcalloc(cdc->dev, size, sizeof(u32),
+		GFP_KERNEL);
+	if (!cdc->regcache.dirty || !cdc->regcache.valid
+		|| !cdc->regcache.regs) {
+		cdc->regcache.regs = NULL;
+		return -ENOMEM;
+	}
+
+	cdc->regcache.size = size;
+
+	return 0;
+}
+
+u32 cdc_read_reg (struct cdc_device *cdc, u32 reg)
+{
+	unsigned long flags;
+	u32 val;
+
+	if (!reg_is_cached(cdc, reg))
+		return read_reg(cdc, reg);
+
+	spin_lock_irqsave(&cdc->regcache.lock, flags);
+	if (test_bit(reg, cdc->regcache.valid)) {
+		val = cdc->regcache.regs[reg];
+		atomic64_inc(&cdc->regcache.hits);
+	} else {
+		/* first access, fetch the value left by reset or bootloader */
+		val = read_reg(cdc, reg);
+		cdc->regcache.regs[reg] = val;
+		__set_bit(reg, cdc->regcache.valid);
+	}
+	spin_unlock_irqrestore(&cdc->regcache.lock, flags);
+
+	return val;
+}
+
 void cdc_write_reg (struct cdc_device *cdc, u32 reg, u32 val)
 {
-	iowrite32(val, cdc->mmio + (reg * 4));
+	unsigned long flags;
+
+	if (!reg_is_cached(cdc, reg)) {
+		write_reg(cdc, reg, val);
+		return;
+	}
+
+	/* Only shadowed registers are coalesced. Others may act on the write
+	 * itself, a deliberate rewrite of the same value has to reach them.
+	 */
+	spin_lock_irqsave(&cdc->regcache.lock, flags);
+	if (reg_is_deferrable(reg) && test_bit(reg, cdc->regcache.valid)
+		&& cdc->regcache.regs[reg] == val) {
+		/* already in the hardware or queued for the next flush */
+		atomic64_inc(&cdc->regcache.coalesced);
+		cdc->regcache.unflushed_coalesced++;
+	} else {
+		cdc->regcache.regs[reg] = val;
+		__set_bit(reg, cdc->regcache.valid);
+
+		if (cdc->regcache.deferred && reg_is_deferrable(reg)) {
+			cdc->regcache.dirty[reg / CDC_LAYER_SPAN] |=
+				BIT_ULL(reg % CDC_LAYER_SPAN);
+		} else {
+			write_reg(cdc, reg, val);
+			if (reg_is_deferrable(reg))
+				cdc->regcache.unlatched++;
+		}
+	}
+	spin_unlock_irqrestore(&cdc->regcache.lock, flags);
+}
+
+/* Queue writes to shadowed registers instead of issuing them right away.
+ * They are written to the hardware by cdc_hw_regcache_flush().
+ */
+void cdc_hw_regcache_begin (struct cdc_device *cdc)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&cdc->regcache.lock, flags);
+	cdc->regcache.deferred = true;
+	spin_unlock_irqrestore(&cdc->regcache.lock, flags);
+}
+
+/* Write all queued registers in one burst and stop queueing. Returns the
+ * number of shadowed registers changed since the last flush, i.e. the ones
+ * written now and the ones written directly in the meantime.
+ */
+unsigned int cdc_hw_regcache_flush (struct cdc_device *cdc)
+{
+	unsigned long flags;
+	unsigned int count = 0;
+	unsigned int block;
+
+	if (!cdc->regcache.regs)
+		return 0;
+
+	spin_lock_irqsave(&cdc->regcache.lock, flags);
+	for (block = 0; block <= cdc->hw.layer_count; ++block) {
+		u64 dirty = cdc->regcache.dirty[block];
+
+		while (dirty) {
+			u32 reg = block * CDC_LAYER_SPAN + __ffs64(dirty);
+
+			write_reg(cdc, reg, cdc->regcache.regs[reg]);
+			dirty &= dirty - 1;
+			++count;
+		}
+		cdc->regcache.dirty[block] = 0;
+	}
+	count += cdc->regcache.unlatched;
+	cdc->regcache.unlatched = 0;
+	cdc->regcache.last_written = count;
+	cdc->regcache.last_coalesced = cdc->regcache.unflushed_coalesced;
+	cdc->regcache.unflushed_coalesced = 0;
+	cdc->regcache.flushes++;
+	cdc->regcache.deferred = false;
+	spin_unlock_irqrestore(&cdc->regcache.lock, flags);
+
+	return count;
+}
+
+u32 cdc_read_reg_uncached (struct cdc_device *cdc, u32 reg)
+{
+	if (cdc->sim)
+		return cdc_sim_read_reg(cdc->sim, reg);
+	return ioread32(cdc->mmio + (reg * 4));
 }
 
 static int layer_offset (int layer)
@@ -40,26 +239,25 @@ void cdc_write_layer_reg (struct cdc_device *cdc, int layer, u32 reg, u32 val)
 	cdc_write_reg(cdc, layer_offset(layer) + reg, val);
 }
 
-static u32 read_reg (struct cdc_device *cdc, u32 reg)
-{
-	return ioread32(cdc->mmio + (reg * 4));
-}
-
-static void write_reg (struct cdc_device *cdc, u32 reg, u32 val)
+/* Bypasses the register cache, for write-only ports like the CLUT whose
+ * address is shared with other registers.
+ */
+void cdc_write_layer_reg_uncached (struct cdc_device *cdc, int layer, u32 reg,
+	u32 val)
 {
-	iowrite32(val, cdc->mmio + (reg * 4));
+	write_reg(cdc, layer_offset(layer) + reg, val);
 }
 
 void cdc_irq_set (struct cdc_device *cdc, cdc_irq_type irq, bool enable)
 {
 	u32 status;
 
-	status = read_reg(cdc, CDC_REG_GLOBAL_IRQ_ENABLE);
+	status = cdc_read_reg(cdc, CDC_REG_GLOBAL_IRQ_ENABLE);
 
 	if (enable)
 		status |= irq;
 	else
 		status &= ~(irq);
 
-	write_reg(cdc, CDC_REG_GLOBAL_IRQ_ENABLE, status);
+	cdc_write_reg(cdc, CDC_REG_GLOBAL_IRQ_ENABLE, status);
 }
@@ -13,10 +13,16 @@
 #ifndef CDC_HW_H_
 #define CDC_HW_H_
 
+int cdc_hw_regcache_init (struct cdc_device *cdc);
+void cdc_hw_regcache_begin (struct cdc_device *cdc);
+unsigned int cdc_hw_regcache_flush (struct cdc_device *cdc);
 u32 cdc_read_reg (struct cdc_device *cdc, u32 reg);
+u32 cdc_read_reg_uncached (struct cdc_device *cdc, u32 reg);
 void cdc_write_reg (struct cdc_device *cdc, u32 reg, u32 val);
 u32 cdc_read_layer_reg (struct cdc_device *cdc, int layer, u32 reg);
 void cdc_write_layer_reg (struct cdc_device *cdc, int layer, u32 reg, u32 val);
+void cdc_write_layer_reg_uncached (struct cdc_device *cdc, int layer, u32 reg,
+	u32 val);
 void cdc_irq_set (struct cdc_device *cdc, cdc_irq_type irq, bool enable);
 
 #endif /* CDC_HW_H_ */
@@ -15,29 +15,42 @@
 #include "cdc_drv.h"
 #include "cdc_hw.h"
 #include "cdc_regs.h"
+#include "cdc_trace.h"
 
 static u16 calculateScalingFactor (u16 in, u16 out)
 {
-	u32 factor = ((in - 1) << SCALER_FRACTION) / (out - 1);
+	u32 factor;
+
+	/* A single output pixel only ever samples the first input pixel */
+	if (out <= 1)
+		return 0;
+
+	factor = ((in - 1) << SCALER_FRACTION) / (out - 1);
 	return (u16)(factor & 0xFFFF);
 }
 
-static void updateScalingFactors (struct cdc_device *cdc, int layer)
+/* The phases start the filter at the source offset. h_offset and v_offset
+ * are the sub-pixel parts of the source position in SCALER_FRACTION bits.
+ */
+static void updateScalingFactors (struct cdc_device *cdc, int layer,
+	u16 h_offset, u16 v_offset)
 {
 	u16 in_size;
 	u16 out_size;
 	u16 h_scaling_factor;
 	u16 h_scaling_phase;
 	u16 v_scaling_factor;
+	u16 v_scaling_phase;
 
 	in_size = cdc->planes[layer].fb_width;
 	out_size = cdc->planes[layer].window_width;
 	h_scaling_factor = calculateScalingFactor(in_size, out_size);
-	h_scaling_phase = h_scaling_factor + (1 << SCALER_FRACTION);
+	h_scaling_phase = h_scaling_factor + (1 << SCALER_FRACTION) + h_offset;
 
 	in_size = cdc->planes[layer].fb_height;
 	out_size = cdc->planes[layer].window_height;
 	v_scaling_factor = calculateScalingFactor(in_size, out_size);
+	v_scaling_phase = v_scaling_factor + v_offset;
 
 	cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_SCALER_H_SCALING_FACTOR,
 			    h_scaling_factor);
@@ -46,24 +59,41 @@ static void updateScalingFactors (struct cdc_device *cdc, int layer)
 	cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_SCALER_V_SCALING_FACTOR,
 			    v_scaling_factor);
 	cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_SCALER_V_SCALING_PHASE,
-			    v_scaling_factor);
+			    v_scaling_phase);
 }
 
+/* Also sets up the geometry of an enabled alpha plane. It is fetched with
+ * the same pixels and lines as the color buffer, one byte per pixel.
+ */
 static void updateBufferLength (struct cdc_device *cdc, int layer)
 {
+	struct cdc_plane *plane = &cdc->planes[layer];
 	u32 length;
 	s32 pitch;
 	u8 format_bpp;
 
-	format_bpp = cdc_formats_bpp[cdc->planes[layer].pixel_format];
-	length = cdc->planes[layer].window_width * format_bpp;
+	format_bpp = cdc_formats_bpp[plane->pixel_format];
+	length = plane->fb_width * format_bpp;
 
-	pitch = cdc->planes[layer].fb_pitch;
+	pitch = plane->fb_pitch;
 	if (pitch == 0)
 		pitch = length;
 	length += cdc->hw.bus_width - 1; // add bus_width_in_bits - 1
 	cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_FB_LENGTH,
 		(((u32) pitch) << 16) | length);
+
+	if (!(plane->aux_fb_control & CDC_REG_LAYER_AUX_FB_CONTROL_ENABLE))
+		return;
+
+	length = plane->fb_width;
+	pitch = plane->aux_fb_pitch;
+	if (pitch == 0)
+		pitch = length;
+	length += cdc->hw.bus_width - 1;
+	cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_AUX_FB_LENGTH,
+		(((u32) pitch) << 16) | length);
+	cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_AUX_FB_LINES,
+		plane->fb_height);
 }
 
 static void setEnabled (struct cdc_device *cdc, bool enable)
@@ -113,6 +143,9 @@ void cdc_hw_setWindow (struct cdc_device *cdc, int layer, u16 startX,
 			    ((startY + activeStartY + height) << 16)
 			    | (startY + activeStartY + 1));
 
+	/* Unscaled, the window is fetched 1:1 from the color buffer */
+	cdc->planes[layer].fb_width = width;
+	cdc->planes[layer].fb_height = height;
 	cdc->planes[layer].fb_pitch = pitch;
 	cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_FB_LINES, height);
 
@@ -125,19 +158,24 @@ void cdc_hw_setCBAddress (struct cdc_device *cdc, int layer, dma_addr_t address)
 	cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_FB_START, address);
 }
 
-void cdc_hw_layer_setEnabled (struct cdc_device *cdc, int layer, bool enable)
+static void updateControl (struct cdc_device *cdc, int layer, u32 bits,
+	bool set)
 {
-	if (enable)
-		cdc->planes[layer].control |= CDC_REG_LAYER_CONTROL_ENABLE;
+	if (set)
+		cdc->planes[layer].control |= bits;
 	else
-		cdc->planes[layer].control &= ~CDC_REG_LAYER_CONTROL_ENABLE;
-
-	cdc->planes[layer].enabled = enable;
+		cdc->planes[layer].control &= ~bits;
 
 	cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_CONTROL,
 			    cdc->planes[layer].control);
 }
 
+void cdc_hw_layer_setEnabled (struct cdc_device *cdc, int layer, bool enable)
+{
+	cdc->planes[layer].enabled = enable;
+	updateControl(cdc, layer, CDC_REG_LAYER_CONTROL_ENABLE, enable);
+}
+
 void cdc_hw_resetRegisters (struct cdc_device *cdc)
 {
 	u32 i;
@@ -187,13 +225,13 @@ void cdc_hw_resetRegisters (struct cdc_device *cdc)
 			((CDC_BLEND_PIXEL_ALPHA_X_CONST_ALPHA) << 8)
 				| CDC_BLEND_PIXEL_ALPHA_X_CONST_ALPHA_INV);
 		cdc_write_layer_reg(cdc, i, CDC_REG_LAYER_AUX_FB_CONTROL, 0);
-//    cdc->planes[i].AuxFB_control = 0;
+		cdc->planes[i].aux_fb_control = 0;
 		cdc_write_layer_reg(cdc, i, CDC_REG_LAYER_FB_START, 0);
 		cdc_write_layer_reg(cdc, i, CDC_REG_LAYER_FB_LINES,
 			v_width_accum - v_b_porch_accum);
 		cdc->planes[i].fb_pitch = 0;
 		cdc_write_layer_reg(cdc, i, CDC_REG_LAYER_AUX_FB_START, 0);
-//    cdc->planes[i].AuxFB_pitch = 0;
+		cdc->planes[i].aux_fb_pitch = 0;
 
 		cdc->planes[i].fb_width = cdc->planes[i].window_width;
 		cdc->planes[i].fb_height = cdc->planes[i].window_height;
@@ -213,6 +251,8 @@ void cdc_hw_resetRegisters (struct cdc_device *cdc)
 bool cdc_hw_triggerShadowReload (struct cdc_device *cdc, bool in_vblank)
 {
 	if (cdc->hw.shadow_regs) {
+		trace_cdc_shadow_reload(cdc, in_vblank);
+
 		if (in_vblank)
 			cdc_write_reg(cdc, CDC_REG_GLOBAL_SHADOW_RELOAD, 2);
 		else
@@ -294,9 +334,11 @@ void cdc_hw_setTiming (struct cdc_device *cdc, u16 a_h_sync, u16 a_h_bPorch,
 				| ((back_porch & 0xffffu) + 1));
 		cdc->planes[i].window_width = a_h_width;
 		cdc->planes[i].window_height = a_v_width;
+		cdc->planes[i].fb_width = a_h_width;
+		cdc->planes[i].fb_height = a_v_width;
 		cdc_write_layer_reg(cdc, i, CDC_REG_LAYER_FB_LINES, a_v_width);
 		cdc->planes[i].fb_pitch = 0;
-		// TODO: reset alpha layer pitch if applicable
+		cdc->planes[i].aux_fb_pitch = 0;
 		updateBufferLength(cdc, i);
 		// force reload of all shadowed registers
 		cdc_write_reg(cdc, CDC_REG_GLOBAL_SHADOW_RELOAD, 1);
@@ -317,6 +359,75 @@ void cdc_hw_setBackgroundColor (struct cdc_device *cdc, u32 color)
 	cdc_write_reg(cdc, CDC_REG_GLOBAL_BG_COLOR, color);
 }
 
+void cdc_hw_setBackgroundLayer (struct cdc_device *cdc, bool enable,
+	dma_addr_t address, u32 pitch)
+{
+	if (enable) {
+		cdc_write_reg(cdc, CDC_REG_GLOBAL_BG_LAYER_BASE, address);
+		cdc_write_reg(cdc, CDC_REG_GLOBAL_BG_LAYER_INC, pitch);
+	}
+
+	/* GLOBAL_CONTROL is not shadowed, cdc_hw_applyBackgroundLayer switches
+	 * the layer once base and pitch have been latched.
+	 */
+	cdc->hw.bg_layer_enabled = enable;
+}
+
+void cdc_hw_applyBackgroundLayer (struct cdc_device *cdc)
+{
+	u32 control = cdc_read_reg(cdc, CDC_REG_GLOBAL_CONTROL);
+	u32 new_control = control & ~CDC_REG_GLOBAL_CONTROL_BACKGROUND_LAYER;
+
+	if (cdc->hw.bg_layer_enabled)
+		new_control |= CDC_REG_GLOBAL_CONTROL_BACKGROUND_LAYER;
+	if (new_control != control)
+		cdc_write_reg(cdc, CDC_REG_GLOBAL_CONTROL, new_control);
+}
+
+void cdc_hw_layer_setDefaultColor (struct cdc_device *cdc, int layer,
+	bool enable, u32 color)
+{
+	cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_COLOR, color);
+	updateControl(cdc, layer, CDC_REG_LAYER_CONTROL_DEFAULT_COLOR_BLENDING,
+		enable);
+}
+
+/* The key is compared against the pixels expanded to RGB888. Matching
+ * pixels become transparent or, with replace, show the layer color.
+ */
+void cdc_hw_layer_setColorKey (struct cdc_device *cdc, int layer,
+	bool enable, bool replace, u32 color)
+{
+	if (enable)
+		cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_COLOR_KEY, color);
+	updateControl(cdc, layer, CDC_REG_LAYER_CONTROL_COLOR_KEY_REPLACE,
+		enable && replace);
+	updateControl(cdc, layer, CDC_REG_LAYER_CONTROL_COLOR_KEY_ENABLE,
+		enable);
+}
+
+void cdc_hw_layer_setAlphaPlane (struct cdc_device *cdc, int layer,
+	bool enable, dma_addr_t address, s16 pitch)
+{
+	struct cdc_plane *plane = &cdc->planes[layer];
+
+	plane->aux_fb_control = enable ? CDC_REG_LAYER_AUX_FB_CONTROL_ENABLE
+		: 0;
+	plane->aux_fb_pitch = pitch;
+	if (enable)
+		cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_AUX_FB_START,
+			address);
+	cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_AUX_FB_CONTROL,
+		plane->aux_fb_control);
+	updateBufferLength(cdc, layer);
+}
+
+void cdc_hw_setGammaEntry (struct cdc_device *cdc, u8 index, u32 color)
+{
+	cdc_write_reg(cdc, CDC_REG_GLOBAL_GAMMA,
+		(index << CDC_REG_GLOBAL_GAMMA_INDEX_SHIFT) | (color & 0xffffff));
+}
+
 void cdc_hw_layer_setCBSize (struct cdc_device *cdc, int layer, u16 width,
 	u16 height, s16 pitch)
 {
@@ -326,10 +437,75 @@ void cdc_hw_layer_setCBSize (struct cdc_device *cdc, int layer, u16 width,
 	cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_FB_LINES, height);
 	cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_SCALER_INPUT_SIZE,
 			    (height << 16) | width);
-	updateScalingFactors(cdc, layer);
+	updateScalingFactors(cdc, layer, 0, 0);
+	updateBufferLength(cdc, layer);
+}
+
+void cdc_hw_layer_setScaling (struct cdc_device *cdc, int layer, u16 width,
+	u16 height, u16 h_offset, u16 v_offset)
+{
+	cdc->planes[layer].fb_width = width;
+	cdc->planes[layer].fb_height = height;
+	cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_FB_LINES, height);
+	cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_SCALER_INPUT_SIZE,
+			    (height << 16) | width);
+	cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_SCALER_OUTPUT_SIZE,
+			    (cdc->planes[layer].window_height << 16)
+			    | cdc->planes[layer].window_width);
+	updateScalingFactors(cdc, layer, h_offset, v_offset);
+	updateBufferLength(cdc, layer);
+}
+
+void cdc_hw_layer_setYCbCrScale (struct cdc_device *cdc, int layer,
+	u32 scale_1, u32 scale_2)
+{
+	cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_YCBCR_SCALE_1, scale_1);
+	cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_YCBCR_SCALE_2, scale_2);
+}
+
+/* Duplication doubles the fetched pixels and/or lines, so only half of
+ * the window is read from the color buffer.
+ */
+void cdc_hw_layer_setDuplication (struct cdc_device *cdc, int layer,
+	bool h_dup, bool v_dup)
+{
+	struct cdc_plane *plane = &cdc->planes[layer];
+
+	updateControl(cdc, layer, CDC_REG_LAYER_CONTROL_H_DUPLICATION, h_dup);
+	updateControl(cdc, layer, CDC_REG_LAYER_CONTROL_V_DUPLICATION, v_dup);
+
+	plane->fb_width = h_dup ? DIV_ROUND_UP(plane->window_width, 2)
+		: plane->window_width;
+	plane->fb_height = v_dup ? DIV_ROUND_UP(plane->window_height, 2)
+		: plane->window_height;
+	cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_FB_LINES,
+		plane->fb_height);
 	updateBufferLength(cdc, layer);
 }
 
+void cdc_hw_layer_setMirroring (struct cdc_device *cdc, int layer,
+	bool enable)
+{
+	updateControl(cdc, layer, CDC_REG_LAYER_CONTROL_MIRRORING_ENABLE,
+		enable);
+}
+
+void cdc_hw_layer_setCLUTEnabled (struct cdc_device *cdc, int layer,
+	bool enable)
+{
+	updateControl(cdc, layer, CDC_REG_LAYER_CONTROL_CLUT_ENABLE, enable);
+}
+
+/* The CLUT is loaded through a single write port that shares its address
+ * with SCALER_INPUT_SIZE, so entries bypass the register cache.
+ */
+void cdc_hw_layer_setCLUTEntry (struct cdc_device *cdc, int layer, u8 index,
+	u32 color)
+{
+	cdc_write_layer_reg_uncached(cdc, layer, CDC_REG_LAYER_CLUT,
+		(index << 24) | (color & 0xffffff));
+}
+
 void cdc_hw_layer_setConstantAlpha (struct cdc_device *cdc, int layer, u8 alpha)
 {
 	cdc_write_layer_reg(cdc, layer, CDC_REG_LAYER_ALPHA, alpha);
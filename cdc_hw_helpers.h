@@ -33,8 +33,30 @@ void cdc_hw_setTiming (struct cdc_device *cdc, u16 a_h_sync, u16 a_h_bPorch,
 	bool a_neg_blank, bool a_inv_clk);
 void cdc_hw_setEnabled (struct cdc_device *cdc, bool enable);
 void cdc_hw_setBackgroundColor (struct cdc_device *cdc, u32 color);
+void cdc_hw_setBackgroundLayer (struct cdc_device *cdc, bool enable,
+	dma_addr_t address, u32 pitch);
+void cdc_hw_applyBackgroundLayer (struct cdc_device *cdc);
+void cdc_hw_layer_setDefaultColor (struct cdc_device *cdc, int layer,
+	bool enable, u32 color);
+void cdc_hw_layer_setColorKey (struct cdc_device *cdc, int layer,
+	bool enable, bool replace, u32 color);
+void cdc_hw_layer_setAlphaPlane (struct cdc_device *cdc, int layer,
+	bool enable, dma_addr_t address, s16 pitch);
+void cdc_hw_setGammaEntry (struct cdc_device *cdc, u8 index, u32 color);
 void cdc_hw_layer_setCBSize (struct cdc_device *cdc, int layer, u16 width,
 	u16 height, s16 pitch);
+void cdc_hw_layer_setScaling (struct cdc_device *cdc, int layer, u16 width,
+	u16 height, u16 h_offset, u16 v_offset);
+void cdc_hw_layer_setYCbCrScale (struct cdc_device *cdc, int layer,
+	u32 scale_1, u32 scale_2);
+void cdc_hw_layer_setDuplication (struct cdc_device *cdc, int layer,
+	bool h_dup, bool v_dup);
+void cdc_hw_layer_setMirroring (struct cdc_device *cdc, int layer,
+	bool enable);
+void cdc_hw_layer_setCLUTEnabled (struct cdc_device *cdc, int layer,
+	bool enable);
+void cdc_hw_layer_setCLUTEntry (struct cdc_device *cdc, int layer, u8 index,
+	u32 color);
 void cdc_hw_layer_setConstantAlpha (struct cdc_device *cdc, int layer, u8 alpha);
 
 #endif /* CDC_HW_HELPERS_H_ */
@@ -31,6 +31,25 @@ struct hack_set_alpha {
 	int alpha;
 };
 
+/* Exports the framebuffer a plane currently shows as a read-only dma-buf.
+ * Only the DRM master or CAP_SYS_ADMIN may capture.
+ */
+struct hack_capture {
+	int plane;            /* in: plane index, 0 is the primary plane, the
+	                         layer count selects the background plane */
+	int fd;               /* out: dma-buf file descriptor */
+	unsigned int fourcc;  /* out: DRM pixel format */
+	unsigned int width;   /* out: framebuffer size in pixels */
+	unsigned int height;
+	unsigned int pitch;   /* out: bytes per line */
+	unsigned int offset;  /* out: offset of the first pixel in the buffer */
+	unsigned int size;    /* out: size of the dma-buf in bytes */
+	unsigned int src_x;   /* out: part of the framebuffer being shown */
+	unsigned int src_y;
+	unsigned int src_w;
+	unsigned int src_h;
+};
+
 #define HACK_IOCTL_BASE                  'h'
 #define HACK_IO(nr)                      _IO(HACK_IOCTL_BASE,nr)
 #define HACK_IOR(nr,type)                _IOR(HACK_IOCTL_BASE,nr,type)
@@ -44,5 +63,6 @@ struct hack_set_alpha {
 #define HACK_IOCTL_SET_WINPOS            HACK_IOW(0xe1, hack_set_winpos)
 #define HACK_IOCTL_SET_ALPHA             HACK_IOW(0xe2, hack_set_alpha)
 #define HACK_IOCTL_WAIT_VSYNC            HACK_IO( 0xe3)
+#define HACK_IOCTL_CAPTURE               HACK_IOWR(0xe4, struct hack_capture)
 
 #endif /* CDC_IOCTL_H_ */
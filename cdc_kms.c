@@ -11,7 +11,10 @@
  */
 
 #include <linux/clk.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
 #include <linux/mutex.h>
+#include <linux/sched.h>
 
 #include <drm/drmP.h>
 #include <drm/drm_crtc.h>
@@ -34,6 +37,17 @@
 #include "cdc_crtc.h"
 #include "cdc_plane.h"
 #include "cdc_encoder.h"
+#include "cdc_sim.h"
+#include "cdc_trace.h"
+
+static int commit_prio;
+module_param(commit_prio, int, 0444);
+MODULE_PARM_DESC(commit_prio,
+	"SCHED_FIFO priority of the commit worker (0 = SCHED_NORMAL)");
+
+static int commit_cpu = -1;
+module_param(commit_cpu, int, 0444);
+MODULE_PARM_DESC(commit_cpu, "CPU to run the commit worker on (-1 = any)");
 
 /*******************************************************************************
  * Format helper
@@ -47,6 +61,10 @@ static const struct cdc_format cdc_formats[] = {
 	{ 2, DRM_FORMAT_RGB565, 16 },
 	{ 3, DRM_FORMAT_ARGB4444, 16 },
 	{ 4, DRM_FORMAT_ARGB1555, 16 },
+	{ 7, DRM_FORMAT_C8, 8 },
+	{ 8, DRM_FORMAT_YUYV, 16, true },
+	{ 9, DRM_FORMAT_UYVY, 16, true },
+	{ 0, DRM_FORMAT_R8, 8, .aux = true },
 };
 
 const struct cdc_format *
@@ -104,6 +122,127 @@ static void cdc_output_poll_changed(struct drm_device *dev)
 		drm_fbdev_cma_hotplug_event(cdc->fbdev);
 }
 
+/* Returns the bytes the CDC fetches per scanline for the plane and the
+ * lines [y0, y1) of the screen its window covers. Zero if it is not shown.
+ * Relies on the src and dst rectangles computed by the plane atomic_check.
+ */
+static unsigned int cdc_atomic_plane_fetch(struct cdc_device *cdc,
+	struct drm_atomic_state *state, struct drm_plane *plane,
+	int *y0, int *y1)
+{
+	struct drm_plane_state *plane_state;
+	const struct cdc_format *format;
+	unsigned int width, lines, length;
+
+	plane_state = drm_atomic_get_existing_plane_state(state, plane);
+	if (plane_state == NULL)
+		plane_state = plane->state;
+	if (plane_state->fb == NULL || !plane_state->visible)
+		return 0;
+
+	/* Solid fills show the layer color without touching memory */
+	if (to_cdc_plane_state(plane_state)->pixel_source
+		== CDC_PIXEL_SOURCE_SOLID_FILL)
+		return 0;
+
+	format = cdc_format_info(plane_state->fb->pixel_format);
+	if (format == NULL)
+		return 0;
+
+	*y0 = plane_state->dst.y1;
+	*y1 = plane_state->dst.y2;
+
+	/* Same fetch length as programmed into FB_LENGTH */
+	width = DIV_ROUND_UP(plane_state->src.x2, 1 << 16)
+		- (plane_state->src.x1 >> 16);
+	length = width * cdc_formats_bpp[format->cdc_hw_format]
+		+ cdc->hw.bus_width - 1;
+	if (to_cdc_plane_state(plane_state)->alpha_fb)
+		length += width + cdc->hw.bus_width - 1;
+
+	/* A vertically downscaled layer fetches several lines per line */
+	lines = DIV_ROUND_UP(plane_state->src.y2, 1 << 16)
+		- (plane_state->src.y1 >> 16);
+	if (lines > drm_rect_height(&plane_state->dst))
+		length = DIV_ROUND_UP(length * lines,
+			drm_rect_height(&plane_state->dst));
+
+	return length;
+}
+
+/* Returns the bytes fetched for the worst scanline of the CRTC state, i.e.
+ * the line crossed by the most expensive set of overlapping windows. That
+ * line always is the first line of one of the windows.
+ */
+static unsigned int cdc_atomic_line_bytes(struct cdc_device *cdc,
+	struct drm_atomic_state *state, struct drm_crtc_state *crtc_state)
+{
+	struct drm_plane *plane;
+	struct drm_plane *other;
+	unsigned int max = 0;
+
+	drm_atomic_crtc_state_for_each_plane(plane, crtc_state) {
+		unsigned int bytes = 0;
+		int line, y0, y1;
+
+		if (!cdc_atomic_plane_fetch(cdc, state, plane, &line, &y1))
+			continue;
+
+		drm_atomic_crtc_state_for_each_plane(other, crtc_state) {
+			unsigned int fetch;
+
+			fetch = cdc_atomic_plane_fetch(cdc, state, other, &y0,
+				&y1);
+			if (fetch && y0 <= line && line < y1)
+				bytes += fetch;
+		}
+
+		max = max(max, bytes);
+	}
+
+	return max;
+}
+
+/* Rejects configurations whose layer fetches would exceed the memory
+ * bandwidth budget and end in FIFO underruns. Each line has to be fetched
+ * within one line period of the mode.
+ */
+static int cdc_atomic_check_bandwidth(struct drm_device *dev,
+	struct drm_atomic_state *state)
+{
+	struct cdc_device *cdc = dev->dev_private;
+	struct drm_crtc_state *crtc_state;
+	const struct drm_display_mode *mode;
+	unsigned int line_bytes;
+	u64 required;
+
+	if (cdc->hw.max_bandwidth == 0)
+		return 0;
+
+	crtc_state = drm_atomic_get_existing_crtc_state(state, &cdc->crtc);
+	if (crtc_state == NULL || !crtc_state->active)
+		return 0;
+
+	mode = &crtc_state->adjusted_mode;
+	if (mode->crtc_htotal == 0)
+		return 0;
+
+	line_bytes = cdc_atomic_line_bytes(cdc, state, crtc_state);
+	required = div_u64((u64) line_bytes * mode->crtc_clock,
+		mode->crtc_htotal);
+
+	dev_dbg(dev->dev, "%s: %u bytes per line, %llu of %u kB/s\n", __func__,
+		line_bytes, required, cdc->hw.max_bandwidth);
+
+	if (required > cdc->hw.max_bandwidth) {
+		DRM_DEBUG_ATOMIC("bandwidth %llu kB/s exceeds budget of %u kB/s\n",
+			required, cdc->hw.max_bandwidth);
+		return -ENOSPC;
+	}
+
+	return 0;
+}
+
 static int cdc_atomic_check(struct drm_device *dev,
 	struct drm_atomic_state *state)
 {
@@ -112,27 +251,205 @@ static int cdc_atomic_check(struct drm_device *dev,
 	dev_dbg(dev->dev, "%s\n", __func__);
 
 	ret = drm_atomic_helper_check(dev, state);
+	if (ret == 0)
+		ret = cdc_atomic_check_bandwidth(dev, state);
+	trace_cdc_atomic_check(state, ret);
 	if (ret < 0)
 		return ret;
 
 	return 0;
 }
 
-struct cdc_commit {
-	struct work_struct work;
-	struct drm_device *dev;
-	struct drm_atomic_state *state;
-	u32 crtcs;
-};
+static void cdc_atomic_cleanup(struct cdc_commit *commit)
+{
+	struct drm_device *dev = commit->dev;
+	struct drm_atomic_state *old_state = commit->state;
+
+	dev_dbg(dev->dev, "%s\n", __func__);
+
+	drm_atomic_helper_cleanup_planes(dev, old_state);
+
+	/* todo: check if we can make use of the reference counting anywhere
+	 * Maybe use worker threads for the commit? See:
+	 * https://lists.freedesktop.org/archives/intel-gfx-trybot/2016-September/008592.html
+	 */
+	drm_atomic_state_put(old_state);
+
+	kfree(commit);
+}
+
+static void cdc_atomic_cleanup_work(struct work_struct *work)
+{
+	struct cdc_commit
+	*commit = container_of(work, struct cdc_commit, cleanup_work);
+
+	cdc_atomic_cleanup(commit);
+}
+
+/* Counts the interval in the bucket of its power of two in us */
+static void cdc_latency_add(struct cdc_latency *latency, ktime_t from,
+	ktime_t to)
+{
+	s64 us = ktime_us_delta(to, from);
+	unsigned int i = us > 0 ? fls64(us) : 0;
+
+	latency->bucket[min(i, CDC_LATENCY_BUCKETS - 1)]++;
+}
+
+/* Called with commit.lock held */
+static void cdc_atomic_account_latency(struct cdc_device *cdc,
+	struct cdc_commit *commit)
+{
+	struct cdc_latency *latency = cdc->commit.latency;
+
+	cdc_latency_add(&latency[CDC_LATENCY_COMMIT_SWAP],
+		commit->t_commit, commit->t_swap);
+
+	/* Commits without a CRTC never touch the registers */
+	if (ktime_to_ns(commit->t_written) == 0)
+		return;
+
+	cdc_latency_add(&latency[CDC_LATENCY_SWAP_WRITE],
+		commit->t_swap, commit->t_written);
+	cdc_latency_add(&latency[CDC_LATENCY_WRITE_RELOAD],
+		commit->t_written, commit->t_reload);
+	cdc_latency_add(&latency[CDC_LATENCY_RELOAD_EVENT],
+		commit->t_reload, commit->t_event);
+}
+
+/* An async commit is cleaned up once the worker is done with its state and
+ * it is on screen. The flip may complete from atomic_flush, before
+ * drm_atomic_helper_commit_planes() returns to the worker.
+ */
+static void cdc_atomic_put(struct cdc_commit *commit)
+{
+	if (atomic_dec_and_test(&commit->cleanup_refs))
+		schedule_work(&commit->cleanup_work);
+}
+
+/* Called once the commit is visible on screen, possibly from IRQ context.
+ * Ownership of the commit passes to the cleanup work or, for blocking
+ * commits, back to the waiting caller.
+ */
+void cdc_atomic_commit_done(struct cdc_commit *commit)
+{
+	struct cdc_device *cdc = commit->dev->dev_private;
+	unsigned long flags;
+
+	/* Remove the commit from the queue, wake up any waiter. */
+	spin_lock_irqsave(&cdc->commit.lock, flags);
+	commit->hw_done = true;
+	list_del(&commit->node);
+	cdc_atomic_account_latency(cdc, commit);
+	spin_unlock_irqrestore(&cdc->commit.lock, flags);
+	wake_up_all(&cdc->commit.wait);
+
+	if (commit->async)
+		cdc_atomic_put(commit);
+	else
+		complete_all(&commit->flip_done);
+}
+
+/* Called with the registers of the commit written, right before the shadow
+ * reload is armed. From here on the next commit may swap its state in.
+ */
+void cdc_atomic_commit_hw_done(struct cdc_commit *commit)
+{
+	struct cdc_device *cdc = commit->dev->dev_private;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cdc->commit.lock, flags);
+	commit->hw_done = true;
+	spin_unlock_irqrestore(&cdc->commit.lock, flags);
+	wake_up_all(&cdc->commit.wait);
+}
+
+/* The oldest queued commit is the only one allowed to touch the hardware,
+ * all older ones are on screen.
+ */
+static bool cdc_atomic_is_head(struct cdc_device *cdc,
+	struct cdc_commit *commit)
+{
+	unsigned long flags;
+	bool head;
+
+	spin_lock_irqsave(&cdc->commit.lock, flags);
+	head = list_first_entry(&cdc->commit.queue, struct cdc_commit,
+		node) == commit;
+	spin_unlock_irqrestore(&cdc->commit.lock, flags);
+
+	return head;
+}
+
+static bool cdc_atomic_tail_done(struct cdc_device *cdc)
+{
+	struct cdc_commit *tail;
+
+	if (list_empty(&cdc->commit.queue))
+		return true;
+
+	tail = list_last_entry(&cdc->commit.queue, struct cdc_commit, node);
+
+	return tail->hw_done;
+}
+
+static bool cdc_atomic_can_enqueue(struct cdc_device *cdc)
+{
+	unsigned long flags;
+	bool done;
+
+	spin_lock_irqsave(&cdc->commit.lock, flags);
+	done = cdc_atomic_tail_done(cdc);
+	spin_unlock_irqrestore(&cdc->commit.lock, flags);
+
+	return done;
+}
+
+/* True if no queued commit is still writing registers. The caller holds
+ * commit.lock, so no commit can start writing until it is dropped.
+ */
+bool cdc_atomic_hw_idle(struct cdc_device *cdc)
+{
+	assert_spin_locked(&cdc->commit.lock);
+
+	return cdc_atomic_tail_done(cdc);
+}
+
+/* Appends the commit to the queue once the newest queued commit has
+ * written its registers. Plane updates read the current plane state, so
+ * the state must not be swapped before that.
+ */
+static bool cdc_atomic_enqueue(struct cdc_device *cdc,
+	struct cdc_commit *commit)
+{
+	unsigned long flags;
+	bool queued = false;
+
+	spin_lock_irqsave(&cdc->commit.lock, flags);
+	if (cdc_atomic_tail_done(cdc)) {
+		list_add_tail(&commit->node, &cdc->commit.queue);
+		queued = true;
+	}
+	spin_unlock_irqrestore(&cdc->commit.lock, flags);
+
+	return queued;
+}
 
 static void cdc_atomic_complete(struct cdc_commit *commit)
 {
 	struct drm_device *dev = commit->dev;
 	struct cdc_device *cdc = dev->dev_private;
 	struct drm_atomic_state *old_state = commit->state;
+	bool async = commit->async;
+	bool has_crtc = commit->crtcs != 0;
 
 	dev_dbg(dev->dev, "%s\n", __func__);
 
+	/* Wait for the previous commit to reach the screen. */
+	while (!wait_event_timeout(cdc->commit.wait,
+		cdc_atomic_is_head(cdc, commit), msecs_to_jiffies(100)))
+		cdc_crtc_wait_page_flip(&cdc->crtc);
+
 	/* Apply the atomic update. */
 	drm_atomic_helper_commit_modeset_disables(dev, old_state);
 	drm_atomic_helper_commit_modeset_enables(dev, old_state);
@@ -141,33 +458,58 @@ static void cdc_atomic_complete(struct cdc_commit *commit)
 	 * for a disabled CRTC. Check if we manually ignore plane updates in
 	 * this case.
 	 */
+	cdc->commit.active = commit;
 	drm_atomic_helper_commit_planes(dev, old_state, 0);
+	cdc->commit.active = NULL;
 
-	drm_atomic_helper_wait_for_vblanks(dev, old_state);
+	/* The CRTC's atomic_flush arms the shadow reload and completes the
+	 * commit from the line IRQ. Without a CRTC there is nothing to wait
+	 * for. The worker's reference keeps an async commit alive until here.
+	 */
+	if (!has_crtc)
+		cdc_atomic_commit_done(commit);
 
-	drm_atomic_helper_cleanup_planes(dev, old_state);
+	if (async) {
+		cdc_atomic_put(commit);
+		return;
+	}
 
-	/* todo: check if we can make use of the reference counting anywhere
-	 * Maybe use worker threads for the commit? See:
-	 * https://lists.freedesktop.org/archives/intel-gfx-trybot/2016-September/008592.html
-	 */
-	drm_atomic_state_put(old_state);
+	cdc_crtc_wait_page_flip(&cdc->crtc);
+	wait_for_completion(&commit->flip_done);
 
-	/* Complete the commit, wake up any waiter. */
-	spin_lock(&cdc->commit.wait.lock);
-	cdc->commit.pending = 0;
-	wake_up_all_locked(&cdc->commit.wait);
-	spin_unlock(&cdc->commit.wait.lock);
+	cdc_atomic_cleanup(commit);
+}
 
-	kfree(commit);
+static void cdc_atomic_account(struct cdc_device *cdc, ktime_t queued,
+	ktime_t started, ktime_t finished)
+{
+	s64 latency = ktime_us_delta(started, queued);
+	s64 duration = ktime_us_delta(finished, started);
+	unsigned long flags;
+
+	spin_lock_irqsave(&cdc->commit.lock, flags);
+	cdc->commit.stats.count++;
+	cdc->commit.stats.last_latency_us = latency;
+	cdc->commit.stats.max_latency_us =
+		max(cdc->commit.stats.max_latency_us, latency);
+	cdc->commit.stats.last_duration_us = duration;
+	cdc->commit.stats.max_duration_us =
+		max(cdc->commit.stats.max_duration_us, duration);
+	spin_unlock_irqrestore(&cdc->commit.lock, flags);
 }
 
-static void cdc_atomic_work(struct work_struct *work)
+static void cdc_atomic_work(struct kthread_work *work)
 {
 	struct cdc_commit
 	*commit = container_of(work, struct cdc_commit, work);
+	struct cdc_device *cdc = commit->dev->dev_private;
+	ktime_t queued = commit->queued;
+	ktime_t started = ktime_get();
 
+	/* commit may already be freed once this returns */
 	cdc_atomic_complete(commit);
+
+	cdc_atomic_account(cdc, queued, started, ktime_get());
 }
 
 static int cdc_atomic_commit(struct drm_device *dev,
@@ -175,6 +517,7 @@ static int cdc_atomic_commit(struct drm_device *dev,
 {
 	struct cdc_device *cdc = dev->dev_private;
 	struct cdc_commit *commit;
+	ktime_t t_commit = ktime_get();
 	int ret;
 
 	dev_dbg(dev->dev, "%s\n", __func__);
@@ -185,38 +528,53 @@ static int cdc_atomic_commit(struct drm_device *dev,
 
 	/* Allocate the commit object. */
 	commit = kzalloc(sizeof(*commit), GFP_KERNEL);
-	if (commit == NULL)
+	if (commit == NULL) {
+		drm_atomic_helper_cleanup_planes(dev, state);
 		return -ENOMEM;
+	}
 
-	INIT_WORK(&commit->work, cdc_atomic_work);
+	kthread_init_work(&commit->work, cdc_atomic_work);
+	INIT_WORK(&commit->cleanup_work, cdc_atomic_cleanup_work);
+	INIT_LIST_HEAD(&commit->node);
+	init_completion(&commit->flip_done);
 	commit->dev = dev;
 	commit->state = state;
+	commit->async = async;
+	atomic_set(&commit->cleanup_refs, 2);
+	commit->t_commit = t_commit;
 
-	/* Wait until all affected CRTCs have completed previous commits and
-	 * mark them as pending.
-	 */
 	if (state->crtcs[0].ptr)
 		commit->crtcs = 1;
 
-	spin_lock(&cdc->commit.wait.lock);
-	ret = wait_event_interruptible_locked(cdc->commit.wait,
-		!(cdc->commit.pending));
-	if (ret == 0)
-		cdc->commit.pending = 1;
-	spin_unlock(&cdc->commit.wait.lock);
+	trace_cdc_commit_start(cdc, commit);
 
-	if (ret) {
-		kfree(commit);
-		return ret;
+	/* Queue behind the in-flight commits. This only stalls until the
+	 * newest one has written its registers, not until it is on screen.
+	 */
+	while (!cdc_atomic_enqueue(cdc, commit)) {
+		ret = wait_event_interruptible_timeout(cdc->commit.wait,
+			cdc_atomic_can_enqueue(cdc), msecs_to_jiffies(100));
+		if (ret < 0) {
+			drm_atomic_helper_cleanup_planes(dev, state);
+			kfree(commit);
+			return ret;
+		}
+
+		/* The previous commit missed its reload, finish it. */
+		if (ret == 0)
+			cdc_crtc_wait_page_flip(&cdc->crtc);
 	}
 
 	/* Swap the state, this is the point of no return. */
 	drm_atomic_helper_swap_state(state, true);
+	commit->t_swap = ktime_get();
+	trace_cdc_commit_swap(cdc, commit);
 
 	drm_atomic_state_get(state);
-	if (async)
-		schedule_work(&commit->work);
-	else
+	if (async) {
+		commit->queued = ktime_get();
+		kthread_queue_work(cdc->commit.worker, &commit->work);
+	} else
 		cdc_atomic_complete(commit);
 
 	return 0;
@@ -370,6 +728,47 @@ static int cdc_encoders_init(struct cdc_device *cdc)
 	return 0;
 }
 
+static int cdc_commit_worker_init(struct cdc_device *cdc)
+{
+	struct kthread_worker *worker;
+	int ret;
+
+	worker = kthread_create_worker(0, "%s-commit", dev_name(cdc->dev));
+	if (IS_ERR(worker))
+		return PTR_ERR(worker);
+
+	cdc->commit.worker = worker;
+
+	if (commit_prio > 0) {
+		struct sched_param param = {
+			.sched_priority = min(commit_prio, MAX_RT_PRIO - 1),
+		};
+
+		ret = sched_setscheduler(worker->task, SCHED_FIFO, &param);
+		if (ret < 0)
+			dev_warn(cdc->dev, "could not set commit priority: %d\n",
+				ret);
+	}
+
+	if (commit_cpu >= 0) {
+		ret = set_cpus_allowed_ptr(worker->task,
+			cpumask_of(commit_cpu));
+		if (ret < 0)
+			dev_warn(cdc->dev, "could not bind commit worker to CPU %d: %d\n",
+				commit_cpu, ret);
+	}
+
+	return 0;
+}
+
+void cdc_modeset_fini(struct cdc_device *cdc)
+{
+	if (cdc->commit.worker)
+		kthread_destroy_worker(cdc->commit.worker);
+
+	cdc->commit.worker = NULL;
+}
+
 int cdc_modeset_init(struct cdc_device *cdc)
 {
 	struct drm_device *dev = cdc->ddev;
@@ -386,6 +785,12 @@ int cdc_modeset_init(struct cdc_device *cdc)
 	dev->mode_config.max_height = CDC_MAX_HEIGHT;
 	dev->mode_config.funcs = &cdc_mode_config_funcs;
 
+	ret = cdc_commit_worker_init(cdc);
+	if (ret < 0) {
+		dev_err(cdc->dev, "failed to create commit worker\n");
+		return ret;
+	}
+
 	/* Initialize vertical blanking interrupts handling. Start with vblank
 	 * disabled for all CRTCs.
 	 */
@@ -399,7 +804,10 @@ int cdc_modeset_init(struct cdc_device *cdc)
 
 	cdc_crtc_create(cdc);
 
-	cdc_encoders_init(cdc);
+	if (cdc->sim)
+		cdc_sim_output_init(cdc);
+	else
+		cdc_encoders_init(cdc);
 
 	drm_mode_config_reset(dev);
 	drm_kms_helper_poll_init(dev);
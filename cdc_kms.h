@@ -13,6 +13,12 @@
 #ifndef __CDC_KMS_H__
 #define __CDC_KMS_H__
 #include <linux/types.h>
+#include <linux/atomic.h>
+#include <linux/completion.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/workqueue.h>
 
 struct cdc_device;
 struct drm_device;
@@ -23,11 +29,41 @@ struct cdc_format {
 	unsigned int cdc_hw_format;
 	u32 fourcc;
 	unsigned int bpp;
+	bool ycbcr; /* needs a layer with color space converter */
+	bool aux; /* alpha plane only, never scanned out as color */
+};
+
+/* An atomic commit on its way to the hardware. Queued commits are kept in
+ * submission order on cdc_device.commit.queue until they are on screen.
+ */
+struct cdc_commit {
+	struct list_head node;
+	struct kthread_work work;
+	struct work_struct cleanup_work;
+	struct completion flip_done;
+	struct drm_device *dev;
+	struct drm_atomic_state *state;
+	bool async;
+	bool hw_done; /* registers written, protected by commit.lock */
+	atomic_t cleanup_refs; /* async: held by the worker and the flip */
+	u32 crtcs;
+	ktime_t queued; /* handed to the commit worker */
+	/* latency histogram timestamps, see enum cdc_latency_stage */
+	ktime_t t_commit;
+	ktime_t t_swap;
+	ktime_t t_written;
+	ktime_t t_reload;
+	ktime_t t_event;
+	u32 target; /* vblank count the commit is meant for */
 };
 
 int cdc_modeset_init (struct cdc_device *cdc);
+void cdc_modeset_fini (struct cdc_device *cdc);
 int cdc_dumb_create (struct drm_device *dev, struct drm_file *file,
 	struct drm_mode_create_dumb *args);
 const struct cdc_format *cdc_format_info (__u32 drm_fourcc);
+void cdc_atomic_commit_hw_done (struct cdc_commit *commit);
+void cdc_atomic_commit_done (struct cdc_commit *commit);
+bool cdc_atomic_hw_idle (struct cdc_device *cdc);
 
 #endif
@@ -12,6 +12,7 @@
 
 #include <drm/drmP.h>
 #include <drm/drm_crtc.h>
+#include <drm/drm_atomic.h>
 #include <drm/drm_atomic_helper.h>
 #include <drm/drm_plane_helper.h>
 #include <drm/drm_fb_cma_helper.h>
@@ -22,25 +23,83 @@
 #include "cdc_kms.h"
 #include "cdc_plane.h"
 #include "cdc_hw_helpers.h"
+#include "cdc_trace.h"
 
 static struct cdc_plane *to_cdc_plane(struct drm_plane *p)
 {
 	return container_of(p, struct cdc_plane, plane);
 }
 
-void cdc_plane_setup_fb(struct cdc_plane *plane)
+/* The supported rotations reduced to the reflections the layer performs.
+ * Rotating by 180 degrees reflects along both axes.
+ */
+static unsigned int cdc_plane_reflection(const struct drm_plane_state *state)
 {
-	struct cdc_device *cdc = plane->cdc;
-	unsigned int layer = plane->hw_idx;
-	struct drm_framebuffer *fb = plane->plane.state->fb;
+	return drm_rotation_simplify(state->rotation,
+		DRM_ROTATE_0 | DRM_REFLECT_X | DRM_REFLECT_Y)
+		& (DRM_REFLECT_X | DRM_REFLECT_Y);
+}
+
+/* Returns the address of the first fetched pixel of fb, which has cpp bytes
+ * per pixel and covers the same source coordinates as the plane's FB.
+ */
+static dma_addr_t cdc_plane_address(const struct drm_plane_state *state,
+	struct drm_framebuffer *fb, unsigned int cpp)
+{
+	unsigned int reflection = cdc_plane_reflection(state);
+	unsigned int x = state->src.x1 >> 16;
+	unsigned int y = state->src.y1 >> 16;
 	struct drm_gem_cma_object *gem;
 	unsigned int byte_offset;
 
-	byte_offset = (plane->plane.state->src_y >> 16) * fb->pitches[0]
-		+ (plane->plane.state->src_x >> 16) * (fb->bits_per_pixel / 8);
+	/* Mirrored lines are read backwards from their last pixel, a negative
+	 * pitch walks up from the last line.
+	 */
+	if (reflection & DRM_REFLECT_X)
+		x = DIV_ROUND_UP(state->src.x2, 1 << 16) - 1;
+	if (reflection & DRM_REFLECT_Y)
+		y = DIV_ROUND_UP(state->src.y2, 1 << 16) - 1;
+
+	byte_offset = y * fb->pitches[0] + x * cpp;
 	gem = drm_fb_cma_get_gem_obj(fb, 0);
-	cdc_hw_setCBAddress(cdc, layer,
-		gem->paddr + fb->offsets[0] + byte_offset);
+
+	return gem->paddr + fb->offsets[0] + byte_offset;
+}
+
+static dma_addr_t cdc_plane_fb_address(const struct drm_plane_state *state)
+{
+	const struct cdc_format *format =
+		cdc_format_info(state->fb->pixel_format);
+
+	/* Start at the first fetched pixel of the clipped source. DRM leaves
+	 * bits_per_pixel at 0 for YCbCr formats.
+	 */
+	return cdc_plane_address(state, state->fb, format->bpp / 8);
+}
+
+void cdc_plane_setup_fb(struct cdc_plane *plane)
+{
+	struct cdc_device *cdc = plane->cdc;
+	unsigned int layer = plane->hw_idx;
+	struct drm_plane_state *state = plane->plane.state;
+	struct drm_framebuffer *alpha_fb = to_cdc_plane_state(state)->alpha_fb;
+	dma_addr_t addr;
+
+	addr = cdc_plane_fb_address(state);
+	cdc_hw_setCBAddress(cdc, layer, addr);
+
+	if (alpha_fb) {
+		s16 pitch = alpha_fb->pitches[0];
+
+		if (cdc_plane_reflection(state) & DRM_REFLECT_Y)
+			pitch = -pitch;
+		cdc_hw_layer_setAlphaPlane(cdc, layer, true,
+			cdc_plane_address(state, alpha_fb, 1), pitch);
+	} else if (plane->aux_fb_control) {
+		cdc_hw_layer_setAlphaPlane(cdc, layer, false, 0, 0);
+	}
+
+	trace_cdc_plane_update(cdc, layer, addr);
 }
 
 void cdc_plane_setup_window(struct drm_plane *plane)
@@ -48,35 +107,172 @@ void cdc_plane_setup_window(struct drm_plane *plane)
 	struct cdc_plane *cplane = to_cdc_plane(plane);
 	struct cdc_device *cdc = cplane->cdc;
 	unsigned int layer = cplane->hw_idx;
-	const struct drm_display_mode *mode =
-		&plane->state->crtc->state->adjusted_mode;
-	int32_t x = plane->state->crtc_x;
-	int32_t y = plane->state->crtc_y;
-	int32_t w = plane->state->crtc_w;
-	int32_t h = plane->state->crtc_h;
-
-	/* Do clipping. CDC requires windows that lie inside of the screen. */
-	if (x >= mode->hdisplay)
-		x = mode->hdisplay - 1;
-	if (y >= mode->vdisplay)
-		y = mode->vdisplay - 1;
-	if ((x + w) > mode->hdisplay)
-		w -= x + w - mode->hdisplay;
-	if ((y + h) > mode->vdisplay)
-		h -= y + h - mode->vdisplay;
+	struct drm_plane_state *state = plane->state;
+	struct cdc_plane_state *cstate = to_cdc_plane_state(state);
+	unsigned int reflection = cdc_plane_reflection(state);
+	s16 pitch = state->fb->pitches[0];
+	/* dst is clipped to the screen by cdc_plane_check_state(). CDC requires
+	 * windows that lie inside of the screen.
+	 */
+	int32_t x = state->dst.x1;
+	int32_t y = state->dst.y1;
+	int32_t w = drm_rect_width(&state->dst);
+	int32_t h = drm_rect_height(&state->dst);
 
 	dev_dbg(cdc->dev, "%s for layer %d (plane: 0x%p, cdc: 0x%p, crtc: 0x%p)\n",
 		__func__, layer, plane, cdc, plane->crtc);
-	dev_dbg(cdc->dev, "plane state crtc: %d\n", plane->state->crtc->base.id);
-	dev_dbg(cdc->dev, "setWindow(%d,%d:%dx%d)@%dx%d\n", x, y, w, h, mode->hdisplay,
-		mode->vdisplay);
+	dev_dbg(cdc->dev, "plane state crtc: %d\n", state->crtc->base.id);
+	dev_dbg(cdc->dev, "setWindow(%d,%d:%dx%d)\n", x, y, w, h);
 
 	cdc->planes[layer].window_width = w;
 	cdc->planes[layer].window_height = h;
 	cdc->planes[layer].window_x = x;
 	cdc->planes[layer].window_y = y;
 
-	cdc_hw_setWindow(cdc, layer, x, y, w, h, plane->state->fb->pitches[0]);
+	if (reflection & DRM_REFLECT_Y)
+		pitch = -pitch;
+
+	cdc_hw_setWindow(cdc, layer, x, y, w, h, pitch);
+	cdc_hw_layer_setMirroring(cdc, layer, reflection & DRM_REFLECT_X);
+
+	/* Layers without scaler double the source by pixel duplication */
+	if (!(cplane->config_2 & CDC_REG_LAYER_CONFIG_SCALER_ENABLED))
+		cdc_hw_layer_setDuplication(cdc, layer, cstate->h_dup,
+			cstate->v_dup);
+	else if (cstate->pixel_source == CDC_PIXEL_SOURCE_FB) {
+		const struct drm_rect *src = &state->src;
+		/* Mirrored fetches start at the far edge of the source */
+		u16 h_offset = (reflection & DRM_REFLECT_X) ? -src->x2 : src->x1;
+		u16 v_offset = (reflection & DRM_REFLECT_Y) ? -src->y2 : src->y1;
+
+		/* Fetch every source pixel the window touches and start the
+		 * filter at the sub-pixel source position.
+		 */
+		cdc_hw_layer_setScaling(cdc, layer,
+			DIV_ROUND_UP(src->x2, 1 << 16) - (src->x1 >> 16),
+			DIV_ROUND_UP(src->y2, 1 << 16) - (src->y1 >> 16),
+			h_offset >> (16 - SCALER_FRACTION),
+			v_offset >> (16 - SCALER_FRACTION));
+	}
+}
+
+/* Conversion coefficients per COLOR_ENCODING and COLOR_RANGE. Limited range
+ * expands Y from 16..235 and CbCr from 16..240 to the full output range.
+ */
+#define CDC_YCBCR_SCALE(y, cr_r, cb_b, cr_g, cb_g, y_offset) { \
+	CDC_REG_LAYER_YCBCR_SCALE_1_Y(y) \
+		| CDC_REG_LAYER_YCBCR_SCALE_1_CR_R(cr_r) \
+		| CDC_REG_LAYER_YCBCR_SCALE_1_CB_B(cb_b), \
+	((y_offset) ? CDC_REG_LAYER_YCBCR_SCALE_2_Y_OFFSET : 0) \
+		| CDC_REG_LAYER_YCBCR_SCALE_2_CR_G(cr_g) \
+		| CDC_REG_LAYER_YCBCR_SCALE_2_CB_G(cb_g) }
+
+static const u32 cdc_ycbcr_scale[CDC_COLOR_ENCODING_MAX][CDC_COLOR_RANGE_MAX][2] = {
+	[CDC_COLOR_YCBCR_BT601] = {
+		[CDC_COLOR_YCBCR_LIMITED_RANGE] =
+			CDC_YCBCR_SCALE(298, 409, 516, 208, 100, true),
+		[CDC_COLOR_YCBCR_FULL_RANGE] =
+			CDC_YCBCR_SCALE(256, 359, 454, 183, 88, false),
+	},
+	[CDC_COLOR_YCBCR_BT709] = {
+		[CDC_COLOR_YCBCR_LIMITED_RANGE] =
+			CDC_YCBCR_SCALE(298, 459, 541, 136, 55, true),
+		[CDC_COLOR_YCBCR_FULL_RANGE] =
+			CDC_YCBCR_SCALE(256, 403, 475, 120, 48, false),
+	},
+};
+
+static void cdc_plane_setup_ycbcr(struct cdc_plane *cplane,
+	const struct cdc_plane_state *cstate)
+{
+	const u32 *scale =
+		cdc_ycbcr_scale[cstate->color_encoding][cstate->color_range];
+
+	dev_dbg(cplane->cdc->dev, "Plane %d: YCbCr encoding %d, range %d\n",
+		cplane->hw_idx, cstate->color_encoding, cstate->color_range);
+
+	cdc_hw_layer_setYCbCrScale(cplane->cdc, cplane->hw_idx, scale[0],
+		scale[1]);
+}
+
+/* The CLUT is not shadowed. Like the gamma RAM, a new palette is written at
+ * the start of vblank, or right away while the CRTC is off.
+ */
+static void cdc_plane_write_clut(struct cdc_plane *cplane)
+{
+	struct cdc_device *cdc = cplane->cdc;
+	u32 *table = cdc->lut_upload.table;
+	unsigned long flags;
+	bool pending;
+	unsigned int i;
+
+	BUILD_BUG_ON(CDC_LAYER_CLUT_SIZE > ARRAY_SIZE(cdc->lut_upload.table));
+
+	spin_lock_irqsave(&cdc->lut_upload.lock, flags);
+
+	spin_lock(&cdc->commit.lock);
+	pending = cplane->clut_pending;
+	if (pending) {
+		memcpy(table, cplane->clut,
+			CDC_LAYER_CLUT_SIZE * sizeof(*cplane->clut));
+		cplane->clut_pending = false;
+	}
+	spin_unlock(&cdc->commit.lock);
+
+	if (pending)
+		for (i = 0; i < CDC_LAYER_CLUT_SIZE; ++i)
+			cdc_hw_layer_setCLUTEntry(cdc, cplane->hw_idx, i,
+				table[i]);
+
+	spin_unlock_irqrestore(&cdc->lut_upload.lock, flags);
+}
+
+void cdc_planes_write_clut(struct cdc_device *cdc)
+{
+	int i;
+
+	for (i = 0; i < cdc->hw.layer_count; ++i)
+		if (cdc->planes[i].clut)
+			cdc_plane_write_clut(&cdc->planes[i]);
+}
+
+static void cdc_plane_setup_clut(struct cdc_plane *cplane,
+	const struct cdc_plane_state *cstate)
+{
+	struct cdc_device *cdc = cplane->cdc;
+	const struct drm_color_lut *lut = NULL;
+	unsigned int size = 0;
+	unsigned long flags;
+	unsigned int i;
+	u32 color;
+
+	if (cstate->palette) {
+		lut = cstate->palette->data;
+		size = cstate->palette->length / sizeof(*lut);
+	}
+
+	dev_dbg(cdc->dev, "Plane %d: uploading %u palette entries\n",
+		cplane->hw_idx, lut ? size : CDC_LAYER_CLUT_SIZE);
+
+	spin_lock_irqsave(&cdc->commit.lock, flags);
+	for (i = 0; i < CDC_LAYER_CLUT_SIZE; ++i) {
+		if (lut == NULL)
+			color = i * 0x010101;
+		else if (i < size)
+			color = ((lut[i].red >> 8) << 16)
+				| ((lut[i].green >> 8) << 8) | (lut[i].blue >> 8);
+		else
+			color = 0;
+
+		cplane->clut[i] = color;
+	}
+	cplane->clut_pending = true;
+	spin_unlock_irqrestore(&cdc->commit.lock, flags);
+
+	if (!cdc->hw.enabled)
+		cdc_plane_write_clut(cplane);
+
+	cplane->clut_loaded = true;
 }
 
 int cdc_plane_disable(struct drm_plane *plane)
@@ -97,6 +293,260 @@ int cdc_plane_disable(struct drm_plane *plane)
 	return 0;
 }
 
+/* Scaling limits of the layer scaler. The factor register holds 3 integer
+ * bits, which together with the phase offset leaves room for 4x downscaling.
+ */
+#define CDC_PLANE_SCALE_MIN (DRM_PLANE_HELPER_NO_SCALING / 8)
+#define CDC_PLANE_SCALE_MAX (DRM_PLANE_HELPER_NO_SCALING * 4)
+
+/* Computes the clipped src and dst rectangles and the visibility of the
+ * plane state for the given mode. Only layers with a scaler may use a
+ * source size that differs from the window size. Layers without one may
+ * still show the source at exactly twice its width and/or height through
+ * pixel duplication.
+ */
+static int cdc_plane_check_state(struct cdc_plane *cplane,
+	struct drm_plane_state *state, const struct drm_display_mode *mode)
+{
+	struct cdc_plane_state *cstate = to_cdc_plane_state(state);
+	struct drm_rect clip = {
+		.x2 = mode->hdisplay,
+		.y2 = mode->vdisplay,
+	};
+	int min_scale = DRM_PLANE_HELPER_NO_SCALING;
+	int max_scale = DRM_PLANE_HELPER_NO_SCALING;
+	int ret;
+
+	cstate->h_dup = false;
+	cstate->v_dup = false;
+
+	if (cstate->pixel_source == CDC_PIXEL_SOURCE_SOLID_FILL) {
+		/* Nothing is fetched, the source does not matter */
+		min_scale = 0;
+		max_scale = INT_MAX;
+	} else if (cplane->config_2 & CDC_REG_LAYER_CONFIG_SCALER_ENABLED) {
+		min_scale = CDC_PLANE_SCALE_MIN;
+		max_scale = CDC_PLANE_SCALE_MAX;
+	} else {
+		cstate->h_dup = state->src_w && ((uint64_t) state->src_w << 1)
+			== ((uint64_t) state->crtc_w << 16);
+		cstate->v_dup = state->src_h && ((uint64_t) state->src_h << 1)
+			== ((uint64_t) state->crtc_h << 16);
+		if (cstate->h_dup || cstate->v_dup)
+			min_scale = DRM_PLANE_HELPER_NO_SCALING / 2;
+	}
+
+	ret = drm_plane_helper_check_state(state, &clip, min_scale, max_scale,
+		true, true);
+	if (ret < 0)
+		return ret;
+
+	/* The scale limits cover both axes, the other one has to be 1:1 */
+	if ((cstate->h_dup && !cstate->v_dup
+			&& state->src_h != (state->crtc_h << 16))
+		|| (cstate->v_dup && !cstate->h_dup
+			&& state->src_w != (state->crtc_w << 16)))
+		return -ERANGE;
+
+	return 0;
+}
+
+/* The alpha plane is fetched at the source coordinates of the color FB. The
+ * color has to come without an alpha channel of its own.
+ */
+static int cdc_plane_check_alpha_fb(const struct drm_plane_state *state)
+{
+	struct drm_framebuffer *alpha_fb =
+		to_cdc_plane_state(state)->alpha_fb;
+
+	if (to_cdc_plane_state(state)->pixel_source != CDC_PIXEL_SOURCE_FB)
+		return 0;
+
+	if ((state->fb->pixel_format != DRM_FORMAT_RGB565)
+		&& (state->fb->pixel_format != DRM_FORMAT_RGB888)) {
+		DRM_DEBUG_ATOMIC("alpha plane needs RGB565 or RGB888 color\n");
+		return -EINVAL;
+	}
+
+	if ((alpha_fb->width < DIV_ROUND_UP(state->src.x2, 1 << 16))
+		|| (alpha_fb->height < DIV_ROUND_UP(state->src.y2, 1 << 16))) {
+		DRM_DEBUG_ATOMIC("alpha plane smaller than the source\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/* Returns the register groups atomic_update has to write to go from the old
+ * to the new plane state. A mode set resets the layer registers, a plane
+ * that was hidden is set up from scratch.
+ */
+static u32 cdc_plane_changes(const struct drm_plane_state *old,
+	const struct drm_plane_state *state, bool modeset)
+{
+	const struct cdc_plane_state *old_cstate =
+		container_of(old, const struct cdc_plane_state, state);
+	const struct cdc_plane_state *cstate =
+		container_of(state, const struct cdc_plane_state, state);
+	bool src_changed = !drm_rect_equals(&old->src, &state->src);
+	u32 changed = 0;
+
+	if (modeset || !old->crtc || !old->visible || !old->fb)
+		return CDC_PLANE_CHANGED_ALL;
+
+	if (old->fb != state->fb || src_changed
+		|| old->rotation != state->rotation
+		|| old_cstate->alpha_fb != cstate->alpha_fb)
+		changed |= CDC_PLANE_CHANGED_FB;
+
+	if (old->fb->pixel_format != state->fb->pixel_format
+		|| old_cstate->alpha_fb != cstate->alpha_fb
+		|| old_cstate->color_encoding != cstate->color_encoding
+		|| old_cstate->color_range != cstate->color_range
+		|| old_cstate->pixel_source != cstate->pixel_source
+		|| old_cstate->fill_color != cstate->fill_color
+		|| old_cstate->colorkey_mode != cstate->colorkey_mode
+		|| old_cstate->colorkey != cstate->colorkey)
+		changed |= CDC_PLANE_CHANGED_FORMAT;
+
+	if (old->fb->pitches[0] != state->fb->pitches[0] || src_changed
+		|| !drm_rect_equals(&old->dst, &state->dst)
+		|| old->rotation != state->rotation
+		|| old_cstate->pixel_source != cstate->pixel_source)
+		changed |= CDC_PLANE_CHANGED_WINDOW;
+
+	if (old_cstate->alpha != cstate->alpha)
+		changed |= CDC_PLANE_CHANGED_ALPHA;
+
+	return changed;
+}
+
+static int cdc_plane_atomic_check(struct drm_plane *plane,
+	struct drm_plane_state *state)
+{
+	struct drm_crtc_state *crtc_state;
+	int ret;
+
+	if (state->crtc == NULL) {
+		state->visible = false;
+		return 0;
+	}
+
+	crtc_state = drm_atomic_get_crtc_state(state->state, state->crtc);
+	if (IS_ERR(crtc_state))
+		return PTR_ERR(crtc_state);
+
+	ret = cdc_plane_check_state(to_cdc_plane(plane), state,
+		&crtc_state->adjusted_mode);
+	if (ret < 0 || !state->visible)
+		return ret;
+
+	/* 4:2:2 pixel pairs share their chroma, fetches start on a pair */
+	if ((to_cdc_plane_state(state)->pixel_source == CDC_PIXEL_SOURCE_FB)
+		&& cdc_format_info(state->fb->pixel_format)->ycbcr
+		&& ((state->src.x1 >> 16) & 1)) {
+		DRM_DEBUG_ATOMIC("YCbCr source must start at an even pixel\n");
+		return -EINVAL;
+	}
+
+	/* Mirroring would start the fetch in the middle of a pixel pair */
+	if ((to_cdc_plane_state(state)->pixel_source == CDC_PIXEL_SOURCE_FB)
+		&& cdc_format_info(state->fb->pixel_format)->ycbcr
+		&& (cdc_plane_reflection(state) & DRM_REFLECT_X)) {
+		DRM_DEBUG_ATOMIC("YCbCr planes cannot be mirrored\n");
+		return -EINVAL;
+	}
+
+	/* Transparent keying blends with the pixel alpha, XRGB8888 would use
+	 * its padding byte
+	 */
+	if ((to_cdc_plane_state(state)->pixel_source == CDC_PIXEL_SOURCE_FB)
+		&& (to_cdc_plane_state(state)->colorkey_mode
+			== CDC_COLORKEY_TRANSPARENT)
+		&& (state->fb->pixel_format == DRM_FORMAT_XRGB8888)) {
+		DRM_DEBUG_ATOMIC("XRGB8888 planes cannot be color keyed\n");
+		return -EINVAL;
+	}
+
+	/* The layer format lists never offer alpha plane formats */
+	if ((to_cdc_plane_state(state)->pixel_source == CDC_PIXEL_SOURCE_FB)
+		&& cdc_format_info(state->fb->pixel_format)->aux)
+		return -EINVAL;
+
+	if (to_cdc_plane_state(state)->alpha_fb) {
+		ret = cdc_plane_check_alpha_fb(state);
+		if (ret < 0)
+			return ret;
+	}
+
+	to_cdc_plane_state(state)->changed = cdc_plane_changes(plane->state,
+		state, drm_atomic_crtc_needs_modeset(crtc_state));
+
+	return 0;
+}
+
+static void cdc_plane_setup_blending(struct cdc_plane *cplane,
+	bool pixel_alpha)
+{
+	// note: in the CDC default config, only CONS_ALPHA(_INV) and ALPHA_X_CONST_ALPHA(_INV) are available
+	if (pixel_alpha) {
+		cdc_hw_setBlendMode(cplane->cdc, cplane->hw_idx,
+			CDC_BLEND_PIXEL_ALPHA_X_CONST_ALPHA,
+			CDC_BLEND_PIXEL_ALPHA_X_CONST_ALPHA_INV);
+	} else {
+		// No blending, ignore the alpha value
+		cdc_hw_setBlendMode(cplane->cdc, cplane->hw_idx,
+			CDC_BLEND_CONST_ALPHA, CDC_BLEND_CONST_ALPHA_INV);
+	}
+}
+
+static void cdc_plane_setup_format(struct cdc_plane *cplane)
+{
+	struct cdc_device *cdc = cplane->cdc;
+	struct drm_plane_state *state = cplane->plane.state;
+	struct cdc_plane_state *cstate = to_cdc_plane_state(state);
+	const struct cdc_format *format;
+	int layer = cplane->hw_idx;
+
+	format = cdc_format_info(state->fb->pixel_format);
+	cdc_hw_setPixelFormat(cdc, layer, format->cdc_hw_format);
+
+	if (format->ycbcr)
+		cdc_plane_setup_ycbcr(cplane, cstate);
+
+	cdc_hw_layer_setCLUTEnabled(cdc, layer,
+		state->fb->pixel_format == DRM_FORMAT_C8);
+
+	cdc_hw_layer_setColorKey(cdc, layer,
+		cstate->colorkey_mode != CDC_COLORKEY_DISABLED,
+		cstate->colorkey_mode == CDC_COLORKEY_REPLACE, cstate->colorkey);
+
+	// Enable pixel alpha for overlay layers with an alpha channel and for
+	// layers whose alpha comes from the alpha plane or the color key
+	cdc_plane_setup_blending(cplane,
+		((layer != 0) && !format->ycbcr
+			&& (state->fb->pixel_format != DRM_FORMAT_XRGB8888)
+			&& (state->fb->pixel_format != DRM_FORMAT_C8))
+		|| cstate->alpha_fb
+		|| (cstate->colorkey_mode == CDC_COLORKEY_TRANSPARENT));
+}
+
+/* Writes the FB and window register groups in changed. A moved plane only
+ * touches these, the cursor fast path uses this as well.
+ */
+static void cdc_plane_setup_position(struct cdc_plane *cplane, u32 changed)
+{
+	struct cdc_plane_state *cstate = to_cdc_plane_state(cplane->plane.state);
+
+	if ((cstate->pixel_source == CDC_PIXEL_SOURCE_FB)
+		&& (changed & CDC_PLANE_CHANGED_FB))
+		cdc_plane_setup_fb(cplane);
+
+	/* The source size feeds the window registers as well */
+	if (changed & CDC_PLANE_CHANGED_WINDOW)
+		cdc_plane_setup_window(&cplane->plane);
+}
+
 static void cdc_plane_atomic_update(struct drm_plane *plane,
 	struct drm_plane_state *old_state)
 {
@@ -106,52 +556,106 @@ static void cdc_plane_atomic_update(struct drm_plane *plane,
 	struct cdc_plane_state *old_cstate = to_cdc_plane_state(old_state);
 	struct cdc_plane_state *new_cstate = to_cdc_plane_state(plane->state);
 	int layer = cplane->hw_idx;
+	bool fill = new_cstate->pixel_source == CDC_PIXEL_SOURCE_SOLID_FILL;
+	u32 changed = new_cstate->changed;
 
-	dev_dbg(cdc->dev, "%s (plane: %d)\n", __func__, cplane->hw_idx);
+	dev_dbg(cdc->dev, "%s (plane: %d, changed: 0x%x)\n", __func__,
+		cplane->hw_idx, changed);
 
-	if (old_cstate->alpha != new_cstate->alpha) {
+	if (new_state->visible && (changed & CDC_PLANE_CHANGED_ALPHA)) {
 		dev_dbg(cdc->dev, "Plane %d: setting alpha to %u\n", layer,
 			new_cstate->alpha);
 		cdc_hw_layer_setConstantAlpha(cdc, layer, new_cstate->alpha);
 	}
 
-	// Setup the plane if a crtc is bound to it
-	if (new_state->crtc) {
-		/* plane setup */
-		/* todo: find out what to change and only change that, like with the window */
-		cdc_hw_setPixelFormat(cdc, layer,
-			cdc_format_info(new_state->fb->pixel_format)->cdc_hw_format);
-
-		// note: in the CDC default config, only CONS_ALPHA(_INV) and ALPHA_X_CONST_ALPHA(_INV) are available
-		if ((layer != 0)
-			&& (new_state->fb->pixel_format != DRM_FORMAT_XRGB8888)) {
-			// Enable pixel alpha for overlay layers only
-			cdc_hw_setBlendMode(cdc, layer,
-				CDC_BLEND_PIXEL_ALPHA_X_CONST_ALPHA,
-				CDC_BLEND_PIXEL_ALPHA_X_CONST_ALPHA_INV);
-		} else {
-			// No blending for primary layer and layers with XRGB8888 format (ignore the alpha value)
-			cdc_hw_setBlendMode(cdc, layer, CDC_BLEND_CONST_ALPHA,
-				CDC_BLEND_CONST_ALPHA_INV);
-		}
+	/* The CLUT is not shadowed, only rewrite it when the palette changed */
+	if (cplane->clut && (!cplane->clut_loaded
+			|| old_cstate->palette != new_cstate->palette))
+		cdc_plane_setup_clut(cplane, new_cstate);
 
-		cdc_plane_setup_fb(cplane);
+	// Setup the plane if it is shown on a crtc, touching only the register
+	// groups atomic_check found changed
+	if (new_state->crtc && new_state->visible) {
+		if (changed & CDC_PLANE_CHANGED_FORMAT) {
+			cdc_hw_layer_setDefaultColor(cdc, layer, fill,
+				new_cstate->fill_color);
 
-		if ((old_state->crtc_x != new_state->crtc_x)
-			|| (old_state->crtc_y != new_state->crtc_y)
-			|| (old_state->crtc_h != new_state->crtc_h)
-			|| (old_state->crtc_w != new_state->crtc_w)) {
-			cdc_plane_setup_window(plane);
+			if (fill) {
+				/* No fetch, the layer shows its default color */
+				cdc_hw_layer_setCLUTEnabled(cdc, layer, false);
+				cdc_hw_layer_setColorKey(cdc, layer, false, false,
+					0);
+				cdc_hw_layer_setAlphaPlane(cdc, layer, false, 0,
+					0);
+				cdc_plane_setup_blending(cplane, layer != 0);
+			} else {
+				cdc_plane_setup_format(cplane);
+			}
 		}
 
-		if (!old_state->crtc)
+		cdc_plane_setup_position(cplane, changed);
+
+		if (!old_state->crtc || !old_state->visible)
 			cdc_hw_layer_setEnabled(cdc, layer, true);
 
-	} else if (old_state->crtc) {
+	} else if (old_state->crtc && old_state->visible) {
 		cdc_hw_layer_setEnabled(cdc, layer, false);
 	}
 }
 
+/* The palette is a blob of up to 256 struct drm_color_lut entries, the same
+ * layout as the CRTC color management LUTs. Missing entries are black.
+ */
+static int cdc_plane_set_palette(struct cdc_device *cdc,
+	struct cdc_plane_state *cstate, uint64_t id)
+{
+	struct drm_property_blob *blob = NULL;
+
+	if (id != 0) {
+		blob = drm_property_lookup_blob(cdc->ddev, id);
+		if (blob == NULL)
+			return -EINVAL;
+
+		if ((blob->length % sizeof(struct drm_color_lut))
+			|| (blob->length > CDC_LAYER_CLUT_SIZE
+				* sizeof(struct drm_color_lut))) {
+			drm_property_unreference_blob(blob);
+			return -EINVAL;
+		}
+	}
+
+	drm_property_unreference_blob(cstate->palette);
+	cstate->palette = blob;
+
+	return 0;
+}
+
+/* The alpha plane is a separate R8 framebuffer, 4.9 has no fourcc for a
+ * color plane with an alpha plane.
+ */
+static int cdc_plane_set_alpha_fb(struct cdc_device *cdc,
+	struct cdc_plane_state *cstate, uint64_t id)
+{
+	struct drm_framebuffer *fb = NULL;
+
+	if (id) {
+		fb = drm_framebuffer_lookup(cdc->ddev, id);
+		if (fb == NULL)
+			return -EINVAL;
+
+		if (fb->pixel_format != DRM_FORMAT_R8) {
+			drm_framebuffer_unreference(fb);
+			return -EINVAL;
+		}
+	}
+
+	if (cstate->alpha_fb)
+		drm_framebuffer_unreference(cstate->alpha_fb);
+	cstate->alpha_fb = fb;
+
+	return 0;
+}
+
 static int cdc_plane_atomic_set_property(struct drm_plane *plane,
 	struct drm_plane_state *state, struct drm_property *property, uint64_t val)
 {
@@ -161,6 +665,22 @@ static int cdc_plane_atomic_set_property(struct drm_plane *plane,
 
 	if (property == cdc->alpha)
 		cstate->alpha = val;
+	else if (property == cdc->color_encoding)
+		cstate->color_encoding = val;
+	else if (property == cdc->color_range)
+		cstate->color_range = val;
+	else if (property == cdc->palette)
+		return cdc_plane_set_palette(cdc, cstate, val);
+	else if (property == cdc->pixel_source)
+		cstate->pixel_source = val;
+	else if (property == cdc->fill_color)
+		cstate->fill_color = val;
+	else if (property == cdc->colorkey)
+		cstate->colorkey = val;
+	else if (property == cdc->colorkey_mode)
+		cstate->colorkey_mode = val;
+	else if (property == cdc->alpha_fb)
+		return cdc_plane_set_alpha_fb(cdc, cstate, val);
 	else
 		return -EINVAL;
 
@@ -179,6 +699,22 @@ static int cdc_plane_atomic_get_property(struct drm_plane *plane,
 
 	if (property == cdc->alpha)
 		*val = cstate->alpha;
+	else if (property == cdc->color_encoding)
+		*val = cstate->color_encoding;
+	else if (property == cdc->color_range)
+		*val = cstate->color_range;
+	else if (property == cdc->palette)
+		*val = cstate->palette ? cstate->palette->base.id : 0;
+	else if (property == cdc->pixel_source)
+		*val = cstate->pixel_source;
+	else if (property == cdc->fill_color)
+		*val = cstate->fill_color;
+	else if (property == cdc->colorkey)
+		*val = cstate->colorkey;
+	else if (property == cdc->colorkey_mode)
+		*val = cstate->colorkey_mode;
+	else if (property == cdc->alpha_fb)
+		*val = cstate->alpha_fb ? cstate->alpha_fb->base.id : 0;
 	else
 		return -EINVAL;
 
@@ -189,8 +725,15 @@ static void cdc_plane_reset(struct drm_plane *plane)
 {
 	struct cdc_plane_state *state;
 
-	if (plane->state && plane->state->fb)
-		drm_framebuffer_unreference(plane->state->fb);
+	if (plane->state) {
+		if (plane->state->fb)
+			drm_framebuffer_unreference(plane->state->fb);
+		drm_property_unreference_blob(
+			to_cdc_plane_state(plane->state)->palette);
+		if (to_cdc_plane_state(plane->state)->alpha_fb)
+			drm_framebuffer_unreference(
+				to_cdc_plane_state(plane->state)->alpha_fb);
+	}
 
 	kfree(plane->state);
 	plane->state = NULL;
@@ -200,6 +743,9 @@ static void cdc_plane_reset(struct drm_plane *plane)
 		return;
 
 	state->alpha = 255;
+	state->color_encoding = CDC_COLOR_YCBCR_BT601;
+	state->color_range = CDC_COLOR_YCBCR_LIMITED_RANGE;
+	state->state.rotation = DRM_ROTATE_0;
 
 	plane->state = &state->state;
 	plane->state->plane = plane;
@@ -218,6 +764,10 @@ static struct drm_plane_state *
 
 	if (copy->state.fb)
 		drm_framebuffer_reference(copy->state.fb);
+	if (copy->palette)
+		drm_property_reference_blob(copy->palette);
+	if (copy->alpha_fb)
+		drm_framebuffer_reference(copy->alpha_fb);
 
 	return &copy->state;
 }
@@ -227,14 +777,155 @@ static void cdc_plane_atomic_destroy_state(struct drm_plane *plane,
 {
 	if (state->fb)
 		drm_framebuffer_unreference(state->fb);
+	drm_property_unreference_blob(to_cdc_plane_state(state)->palette);
+	if (to_cdc_plane_state(state)->alpha_fb)
+		drm_framebuffer_unreference(to_cdc_plane_state(state)->alpha_fb);
 
 	kfree(to_cdc_plane_state(state));
 }
 
+/* The background layer always covers the whole screen 1:1 */
+static int cdc_bg_plane_atomic_check(struct drm_plane *plane,
+	struct drm_plane_state *state)
+{
+	struct drm_crtc_state *crtc_state;
+	struct drm_rect clip = { 0 };
+
+	if (state->crtc == NULL) {
+		state->visible = false;
+		return 0;
+	}
+
+	crtc_state = drm_atomic_get_crtc_state(state->state, state->crtc);
+	if (IS_ERR(crtc_state))
+		return PTR_ERR(crtc_state);
+
+	clip.x2 = crtc_state->adjusted_mode.hdisplay;
+	clip.y2 = crtc_state->adjusted_mode.vdisplay;
+
+	return drm_plane_helper_check_state(state, &clip,
+		DRM_PLANE_HELPER_NO_SCALING, DRM_PLANE_HELPER_NO_SCALING,
+		false, true);
+}
+
+static void cdc_bg_plane_atomic_update(struct drm_plane *plane,
+	struct drm_plane_state *old_state)
+{
+	struct cdc_device *cdc = to_cdc_plane(plane)->cdc;
+	struct drm_plane_state *state = plane->state;
+	dma_addr_t addr;
+
+	dev_dbg(cdc->dev, "%s\n", __func__);
+
+	if (state->crtc && state->visible) {
+		addr = cdc_plane_fb_address(state);
+		cdc_hw_setBackgroundLayer(cdc, true, addr, state->fb->pitches[0]);
+		trace_cdc_plane_update(cdc, -1, addr);
+	} else if (old_state->crtc && old_state->visible) {
+		cdc_hw_setBackgroundLayer(cdc, false, 0, 0);
+	}
+}
+
+static const struct drm_plane_helper_funcs cdc_bg_plane_helper_funcs = {
+	.atomic_check = cdc_bg_plane_atomic_check,
+	.atomic_update = cdc_bg_plane_atomic_update,
+};
+
 static const struct drm_plane_helper_funcs cdc_plane_helper_funcs = {
+	.atomic_check = cdc_plane_atomic_check,
 	.atomic_update = cdc_plane_atomic_update,
 };
 
+/* Moves the cursor without an atomic commit. Only a position change of a
+ * visible cursor qualifies: the new window is written straight to the
+ * layer and latched with the next shadow reload. The caller holds the
+ * CRTC and plane locks, so no other commit can touch the cursor layer.
+ * commit.lock is held from the idle check until the reload is armed, so no
+ * queued commit starts writing registers in between. With a bandwidth
+ * budget, moves take the atomic path, a new window overlap may exceed it.
+ */
+static bool cdc_plane_cursor_move(struct drm_plane *plane,
+	struct drm_crtc *crtc, struct drm_framebuffer *fb,
+	int crtc_x, int crtc_y, unsigned int crtc_w, unsigned int crtc_h,
+	uint32_t src_x, uint32_t src_y, uint32_t src_w, uint32_t src_h)
+{
+	struct cdc_plane *cplane = to_cdc_plane(plane);
+	struct cdc_device *cdc = cplane->cdc;
+	struct drm_plane_state *state = plane->state;
+	struct cdc_plane_state moved;
+	unsigned long flags;
+	u32 changed;
+
+	if (!cdc->hw.enabled || !crtc->state->active || !state->visible
+		|| cdc->hw.max_bandwidth)
+		return false;
+
+	if ((state->crtc != crtc) || (state->fb != fb)
+		|| (state->crtc_w != crtc_w) || (state->crtc_h != crtc_h)
+		|| (state->src_x != src_x) || (state->src_y != src_y)
+		|| (state->src_w != src_w) || (state->src_h != src_h))
+		return false;
+
+	/* Clip the new position, a cursor leaving the screen takes the full
+	 * path to be disabled.
+	 */
+	moved = *to_cdc_plane_state(state);
+	moved.state.crtc_x = crtc_x;
+	moved.state.crtc_y = crtc_y;
+	if (cdc_plane_check_state(cplane, &moved.state,
+			&crtc->state->adjusted_mode)
+		|| !moved.state.visible)
+		return false;
+
+	changed = cdc_plane_changes(state, &moved.state, false);
+	if (changed & ~(CDC_PLANE_CHANGED_FB | CDC_PLANE_CHANGED_WINDOW))
+		return false;
+
+	spin_lock_irqsave(&cdc->commit.lock, flags);
+	if (!cdc_atomic_hw_idle(cdc)) {
+		spin_unlock_irqrestore(&cdc->commit.lock, flags);
+		return false;
+	}
+
+	state->crtc_x = crtc_x;
+	state->crtc_y = crtc_y;
+	state->src = moved.state.src;
+	state->dst = moved.state.dst;
+
+	cdc_plane_setup_position(cplane, changed);
+	cdc_hw_triggerShadowReload(cdc, true);
+	spin_unlock_irqrestore(&cdc->commit.lock, flags);
+
+	dev_dbg(cdc->dev, "%s: cursor at %d,%d\n", __func__, crtc_x, crtc_y);
+
+	return true;
+}
+
+static int cdc_plane_cursor_update(struct drm_plane *plane,
+	struct drm_crtc *crtc, struct drm_framebuffer *fb,
+	int crtc_x, int crtc_y, unsigned int crtc_w, unsigned int crtc_h,
+	uint32_t src_x, uint32_t src_y, uint32_t src_w, uint32_t src_h)
+{
+	if (cdc_plane_cursor_move(plane, crtc, fb, crtc_x, crtc_y, crtc_w,
+		crtc_h, src_x, src_y, src_w, src_h))
+		return 0;
+
+	return drm_atomic_helper_update_plane(plane, crtc, fb, crtc_x, crtc_y,
+		crtc_w, crtc_h, src_x, src_y, src_w, src_h);
+}
+
+static const struct drm_plane_funcs cdc_cursor_funcs = {
+	.update_plane = cdc_plane_cursor_update,
+	.disable_plane = drm_atomic_helper_disable_plane,
+	.destroy = drm_plane_cleanup,
+	.set_property = drm_atomic_helper_plane_set_property,
+	.atomic_set_property = cdc_plane_atomic_set_property,
+	.atomic_get_property = cdc_plane_atomic_get_property,
+	.reset = cdc_plane_reset,
+	.atomic_duplicate_state = cdc_plane_atomic_duplicate_state,
+	.atomic_destroy_state = cdc_plane_atomic_destroy_state,
+};
+
 static const struct drm_plane_funcs cdc_plane_funcs = {
 	.update_plane = drm_atomic_helper_update_plane,
 	.disable_plane = drm_atomic_helper_disable_plane,
@@ -256,8 +947,71 @@ static const uint32_t cdc_supported_formats[] = {
 	DRM_FORMAT_ARGB1555,
 };
 
+static const uint32_t cdc_bg_formats[] = {
+	DRM_FORMAT_XRGB8888,
+};
+
+/* Formats of layers with a color space converter */
+static const uint32_t cdc_ycbcr_formats[] = {
+	DRM_FORMAT_YUYV,
+	DRM_FORMAT_UYVY,
+};
+
+/* Formats of layers with a CLUT, i.e. without a scaler */
+static const uint32_t cdc_clut_formats[] = {
+	DRM_FORMAT_C8,
+};
+
+static unsigned int cdc_plane_formats(const struct cdc_plane *plane,
+	uint32_t *formats)
+{
+	unsigned int count = ARRAY_SIZE(cdc_supported_formats);
+
+	memcpy(formats, cdc_supported_formats, sizeof(cdc_supported_formats));
+
+	if (plane->config_2 & CDC_REG_LAYER_CONFIG_YCBCR_ENABLED) {
+		memcpy(&formats[count], cdc_ycbcr_formats,
+			sizeof(cdc_ycbcr_formats));
+		count += ARRAY_SIZE(cdc_ycbcr_formats);
+	}
+
+	if (!(plane->config_2 & CDC_REG_LAYER_CONFIG_SCALER_ENABLED)) {
+		memcpy(&formats[count], cdc_clut_formats,
+			sizeof(cdc_clut_formats));
+		count += ARRAY_SIZE(cdc_clut_formats);
+	}
+
+	return count;
+}
+
+/* Names as used by the COLOR_ENCODING/COLOR_RANGE properties of later DRM
+ * versions, so userspace can use the same strings.
+ */
+static const struct drm_prop_enum_list cdc_color_encoding_names[] = {
+	{ CDC_COLOR_YCBCR_BT601, "ITU-R BT.601 YCbCr" },
+	{ CDC_COLOR_YCBCR_BT709, "ITU-R BT.709 YCbCr" },
+};
+
+static const struct drm_prop_enum_list cdc_color_range_names[] = {
+	{ CDC_COLOR_YCBCR_LIMITED_RANGE, "YCbCr limited range" },
+	{ CDC_COLOR_YCBCR_FULL_RANGE, "YCbCr full range" },
+};
+
+static const struct drm_prop_enum_list cdc_pixel_source_names[] = {
+	{ CDC_PIXEL_SOURCE_FB, "FB" },
+	{ CDC_PIXEL_SOURCE_SOLID_FILL, "SOLID_FILL" },
+};
+
+static const struct drm_prop_enum_list cdc_colorkey_mode_names[] = {
+	{ CDC_COLORKEY_DISABLED, "disabled" },
+	{ CDC_COLORKEY_TRANSPARENT, "transparent" },
+	{ CDC_COLORKEY_REPLACE, "replace" },
+};
+
 int cdc_planes_init(struct cdc_device *cdc)
 {
+	uint32_t formats[ARRAY_SIZE(cdc_supported_formats)
+		+ ARRAY_SIZE(cdc_ycbcr_formats) + ARRAY_SIZE(cdc_clut_formats)];
 	int ret;
 	int i;
 
@@ -267,9 +1021,45 @@ int cdc_planes_init(struct cdc_device *cdc)
 	if (cdc->alpha == NULL)
 		return -ENOMEM;
 
+	cdc->color_encoding = drm_property_create_enum(cdc->ddev, 0,
+		"COLOR_ENCODING", cdc_color_encoding_names,
+		ARRAY_SIZE(cdc_color_encoding_names));
+	cdc->color_range = drm_property_create_enum(cdc->ddev, 0,
+		"COLOR_RANGE", cdc_color_range_names,
+		ARRAY_SIZE(cdc_color_range_names));
+	if (cdc->color_encoding == NULL || cdc->color_range == NULL)
+		return -ENOMEM;
+
+	cdc->palette = drm_property_create(cdc->ddev, DRM_MODE_PROP_BLOB,
+		"palette", 0);
+	if (cdc->palette == NULL)
+		return -ENOMEM;
+
+	cdc->pixel_source = drm_property_create_enum(cdc->ddev, 0,
+		"pixel_source", cdc_pixel_source_names,
+		ARRAY_SIZE(cdc_pixel_source_names));
+	cdc->fill_color = drm_property_create_range(cdc->ddev, 0,
+		"fill_color", 0, 0xffffffff);
+	if (cdc->pixel_source == NULL || cdc->fill_color == NULL)
+		return -ENOMEM;
+
+	cdc->colorkey = drm_property_create_range(cdc->ddev, 0, "colorkey", 0,
+		0xffffff);
+	cdc->colorkey_mode = drm_property_create_enum(cdc->ddev, 0,
+		"colorkey_mode", cdc_colorkey_mode_names,
+		ARRAY_SIZE(cdc_colorkey_mode_names));
+	if (cdc->colorkey == NULL || cdc->colorkey_mode == NULL)
+		return -ENOMEM;
+
+	cdc->alpha_fb = drm_property_create_object(cdc->ddev,
+		DRM_MODE_PROP_ATOMIC, "alpha_fb", DRM_MODE_OBJECT_FB);
+	if (cdc->alpha_fb == NULL)
+		return -ENOMEM;
+
 	for (i = 0; i < cdc->hw.layer_count; ++i) {
 		enum drm_plane_type type;
 		struct cdc_plane *plane = &cdc->planes[i];
+		bool ycbcr = plane->config_2 & CDC_REG_LAYER_CONFIG_YCBCR_ENABLED;
 
 		if (i == 0)
 			type = DRM_PLANE_TYPE_PRIMARY;
@@ -280,8 +1070,9 @@ int cdc_planes_init(struct cdc_device *cdc)
 
 		dev_dbg(cdc->dev, "Initializing plane %d as %d type...\n", i, type);
 		ret = drm_universal_plane_init(cdc->ddev, &plane->plane, 1,
-			&cdc_plane_funcs, cdc_supported_formats,
-			ARRAY_SIZE(cdc_supported_formats), type,
+			type == DRM_PLANE_TYPE_CURSOR ?
+				&cdc_cursor_funcs : &cdc_plane_funcs,
+			formats, cdc_plane_formats(plane, formats), type,
 			NULL);
 		if (ret < 0) {
 			dev_err(cdc->dev, "could not initialize plane %d...\n", i);
@@ -290,6 +1081,46 @@ int cdc_planes_init(struct cdc_device *cdc)
 
 		drm_plane_helper_add(&plane->plane, &cdc_plane_helper_funcs);
 
+		drm_object_attach_property(&plane->plane.base,
+			cdc->pixel_source, CDC_PIXEL_SOURCE_FB);
+		drm_object_attach_property(&plane->plane.base,
+			cdc->fill_color, 0);
+		drm_object_attach_property(&plane->plane.base,
+			cdc->colorkey, 0);
+		drm_object_attach_property(&plane->plane.base,
+			cdc->colorkey_mode, CDC_COLORKEY_DISABLED);
+
+		ret = drm_plane_create_rotation_property(&plane->plane,
+			DRM_ROTATE_0, DRM_ROTATE_0 | DRM_ROTATE_180
+				| DRM_REFLECT_X | DRM_REFLECT_Y);
+		if (ret < 0)
+			return ret;
+
+		if (ycbcr) {
+			drm_object_attach_property(&plane->plane.base,
+				cdc->color_encoding, CDC_COLOR_YCBCR_BT601);
+			drm_object_attach_property(&plane->plane.base,
+				cdc->color_range, CDC_COLOR_YCBCR_LIMITED_RANGE);
+		}
+
+		if (!(plane->config_2 & CDC_REG_LAYER_CONFIG_SCALER_ENABLED)) {
+			plane->clut = devm_kcalloc(cdc->dev, CDC_LAYER_CLUT_SIZE,
+				sizeof(*plane->clut), GFP_KERNEL);
+			if (plane->clut == NULL)
+				return -ENOMEM;
+
+			drm_object_attach_property(&plane->plane.base,
+				cdc->palette, 0);
+		}
+
+		/* Only the simulator until the AUX_FB_CONTROL enable bit is
+		 * confirmed, see cdc_regs.h
+		 */
+		if ((plane->config_1 & CDC_REG_LAYER_CONFIG_ALPHA_PLANE)
+			&& cdc->sim)
+			drm_object_attach_property(&plane->plane.base,
+				cdc->alpha_fb, 0);
+
 		if (type != DRM_PLANE_TYPE_OVERLAY)
 			continue;
 
@@ -297,5 +1128,22 @@ int cdc_planes_init(struct cdc_device *cdc)
 		drm_object_attach_property(&plane->plane.base, cdc->alpha, 255);
 	}
 
+	if (!cdc->hw.bg_layer)
+		return 0;
+
+	/* The background layer is an extra overlay below all blended layers */
+	dev_dbg(cdc->dev, "Initializing background plane...\n");
+	cdc->bg_plane.cdc = cdc;
+	cdc->bg_plane.hw_idx = -1;
+	ret = drm_universal_plane_init(cdc->ddev, &cdc->bg_plane.plane, 1,
+		&cdc_plane_funcs, cdc_bg_formats, ARRAY_SIZE(cdc_bg_formats),
+		DRM_PLANE_TYPE_OVERLAY, NULL);
+	if (ret < 0) {
+		dev_err(cdc->dev, "could not initialize background plane...\n");
+		return ret;
+	}
+
+	drm_plane_helper_add(&cdc->bg_plane.plane, &cdc_bg_plane_helper_funcs);
+
 	return 0;
 }
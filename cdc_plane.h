@@ -13,10 +13,56 @@
 #ifndef CDC_PLANE_H_
 #define CDC_PLANE_H_
 
+/* Values of the COLOR_ENCODING and COLOR_RANGE plane properties */
+enum cdc_color_encoding {
+	CDC_COLOR_YCBCR_BT601,
+	CDC_COLOR_YCBCR_BT709,
+	CDC_COLOR_ENCODING_MAX,
+};
+
+enum cdc_color_range {
+	CDC_COLOR_YCBCR_LIMITED_RANGE,
+	CDC_COLOR_YCBCR_FULL_RANGE,
+	CDC_COLOR_RANGE_MAX,
+};
+
+/* Values of the pixel_source plane property */
+enum cdc_pixel_source {
+	CDC_PIXEL_SOURCE_FB,
+	CDC_PIXEL_SOURCE_SOLID_FILL, /* fill_color, the FB is not fetched */
+};
+
+/* Values of the colorkey_mode plane property */
+enum cdc_colorkey_mode {
+	CDC_COLORKEY_DISABLED,
+	CDC_COLORKEY_TRANSPARENT, /* keyed pixels get alpha 0 */
+	CDC_COLORKEY_REPLACE, /* keyed pixels show fill_color */
+};
+
+/* Register groups of a plane that need an update, see cdc_plane_changes() */
+#define CDC_PLANE_CHANGED_FB      BIT(0) /* FB and alpha plane address */
+#define CDC_PLANE_CHANGED_FORMAT  BIT(1) /* format, color key, blending */
+#define CDC_PLANE_CHANGED_WINDOW  BIT(2) /* window, fetch size, scaling */
+#define CDC_PLANE_CHANGED_ALPHA   BIT(3)
+#define CDC_PLANE_CHANGED_ALL     (CDC_PLANE_CHANGED_FB \
+	| CDC_PLANE_CHANGED_FORMAT | CDC_PLANE_CHANGED_WINDOW \
+	| CDC_PLANE_CHANGED_ALPHA)
+
 struct cdc_plane_state {
 	struct drm_plane_state state;
 
 	unsigned int alpha;
+	enum cdc_color_encoding color_encoding;
+	enum cdc_color_range color_range;
+	struct drm_property_blob *palette; /* CLUT for C8, NULL: grey ramp */
+	enum cdc_pixel_source pixel_source;
+	u32 fill_color; /* ARGB8888 */
+	enum cdc_colorkey_mode colorkey_mode;
+	u32 colorkey; /* RGB888 */
+	struct drm_framebuffer *alpha_fb; /* R8 alpha plane, NULL: none */
+	u32 changed; /* CDC_PLANE_CHANGED_*, set by atomic_check if visible */
+	bool h_dup; /* pixel duplication, set by atomic_check */
+	bool v_dup;
 };
 
 static inline struct cdc_plane_state
@@ -26,5 +72,6 @@ static inline struct cdc_plane_state
 }
 
 int cdc_planes_init(struct cdc_device *cdc);
+void cdc_planes_write_clut(struct cdc_device *cdc);
 
 #endif /* CDC_PLANE_H_ */
@@ -50,6 +50,21 @@
 #define CDC_REG_GLOBAL_CONTROL_DITHERING        0x00010000u
 #define CDC_REG_GLOBAL_CONTROL_ENABLE           0x00000001u
 
+// background layer: XRGB8888 image at BG_LAYER_BASE, BG_LAYER_INC bytes per line
+
+// gamma RAM write port: index << 24 | RGB888
+#define CDC_REG_GLOBAL_GAMMA_INDEX_SHIFT        24
+
+//shadow reload bits (cleared by HW once the reload is done)
+#define CDC_REG_GLOBAL_SHADOW_RELOAD_VBLANK     0x00000002u
+#define CDC_REG_GLOBAL_SHADOW_RELOAD_IMMEDIATE  0x00000001u
+
+//sync status bits
+#define CDC_REG_GLOBAL_SYNC_STATUS_HSYNC        0x00000008u
+#define CDC_REG_GLOBAL_SYNC_STATUS_VSYNC        0x00000004u
+#define CDC_REG_GLOBAL_SYNC_STATUS_H_ACTIVE     0x00000002u
+#define CDC_REG_GLOBAL_SYNC_STATUS_V_ACTIVE     0x00000001u
+
 // Layer span (in words)
 #define CDC_LAYER_SPAN 0x40
 
@@ -73,7 +88,8 @@
 #define CDC_REG_LAYER_AUX_FB_START                 0x10
 #define CDC_REG_LAYER_AUX_FB_LENGTH                0x11
 #define CDC_REG_LAYER_AUX_FB_LINES                 0x12
-#define CDC_REG_LAYER_CLUT                         0x13
+#define CDC_REG_LAYER_CLUT                         0x13 // write: index << 24 | RGB888
+#define CDC_LAYER_CLUT_SIZE                        256
 
 #define CDC_REG_LAYER_SCALER_INPUT_SIZE            0x13
 #define CDC_REG_LAYER_SCALER_OUTPUT_SIZE           0x14
@@ -85,15 +101,27 @@
 #define CDC_REG_LAYER_YCBCR_SCALE_2                0x1a
 
 #define SCALER_FRACTION        (13)
+
+// YCbCr to RGB conversion coefficients, unsigned with 8 fraction bits
+#define YCBCR_SCALE_FRACTION   (8)
+#define CDC_REG_LAYER_YCBCR_SCALE_1_Y(x)        (((x) & 0x3ffu) << 20)
+#define CDC_REG_LAYER_YCBCR_SCALE_1_CR_R(x)     (((x) & 0x3ffu) << 10)
+#define CDC_REG_LAYER_YCBCR_SCALE_1_CB_B(x)     ((x) & 0x3ffu)
+#define CDC_REG_LAYER_YCBCR_SCALE_2_Y_OFFSET    0x80000000u // subtract 16 from Y
+#define CDC_REG_LAYER_YCBCR_SCALE_2_CR_G(x)     (((x) & 0x3ffu) << 10) // subtracted
+#define CDC_REG_LAYER_YCBCR_SCALE_2_CB_G(x)     ((x) & 0x3ffu) // subtracted
 //layer config bits
 #define CDC_REG_LAYER_CONFIG_ALPHA_PLANE  0x00000008u
+//aux fb control bits, layers with CONFIG_ALPHA_PLANE only
+//NOTE: not confirmed by the register spec yet, only used with cdc_sim
+#define CDC_REG_LAYER_AUX_FB_CONTROL_ENABLE  0x00000001u // 8 bit alpha plane
 //layer config 2 bits                      
 #define CDC_REG_LAYER_CONFIG_SCALER_ENABLED 0x80000000u
 #define CDC_REG_LAYER_CONFIG_YCBCR_ENABLED  0x40000000u
 
 //layer control bits
 #define CDC_REG_LAYER_CONTROL_DEFAULT_COLOR_BLENDING  0x00000200u
-#define CDC_REG_LAYER_CONTROL_MIRRORING_ENABLE        0x00000100u
+#define CDC_REG_LAYER_CONTROL_MIRRORING_ENABLE        0x00000100u // lines read backwards from FB_START
 #define CDC_REG_LAYER_CONTROL_INSERTION_MODE          0x000000c0u
 #define CDC_REG_LAYER_CONTROL_COLOR_KEY_REPLACE       0x00000020u
 #define CDC_REG_LAYER_CONTROL_CLUT_ENABLE             0x00000010u
@@ -200,6 +228,7 @@ typedef enum {
 	CDC_BLEND_PIXEL_ALPHA_X_CONST_ALPHA_INV = 7,
 } cdc_blend_factor;
 
-static const u8 cdc_formats_bpp[] = { 4, 3, 2, 2, 2, 2, 1, 1 };
+// bytes per pixel, indexed by layer pixel format (8, 9: YCbCr 4:2:2)
+static const u8 cdc_formats_bpp[] = { 4, 3, 2, 2, 2, 2, 1, 1, 2, 2 };
 
 #endif // _CDC_REGS_H_
@@ -0,0 +1,547 @@
+/*
+ * cdc_sim.c  --  CDC Display Controller register model
+ *
+ * Copyright (C) 2017 TES Electronic Solutions GmbH
+ * Author: Christian Thaler <christian.thaler@tes-dst.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * Software model of the CDC register file. It replaces the MMIO window when
+ * the driver binds to a "cdc-sim" device, so the whole KMS path can be run
+ * and benchmarked on machines without the display controller.
+ *
+ * Modelled are the programmed and the active (latched) register sets,
+ * immediate and vertical blanking shadow reloads, the line and reload IRQs
+ * and the scanout position. Scanout itself is timed by a hrtimer running at
+ * the programmed pixel clock; no pixels are fetched.
+ */
+
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+
+#include <drm/drmP.h>
+#include <drm/drm_crtc.h>
+#include <drm/drm_crtc_helper.h>
+#include <drm/drm_atomic_helper.h>
+
+#include "cdc_regs.h"
+#include "cdc_drv.h"
+#include "cdc_sim.h"
+
+static unsigned int sim_layers = 3;
+module_param(sim_layers, uint, 0444);
+MODULE_PARM_DESC(sim_layers, "Number of layers of the simulated CDC (1-31)");
+
+struct cdc_sim {
+	struct cdc_device *cdc;
+
+	u32 *regs;   /* programmed values */
+	u32 *active; /* values latched by the last shadow reload */
+	unsigned int size;
+	u32 irq_status;
+	spinlock_t lock;
+
+	unsigned int clock_khz;
+	bool running;
+	struct hrtimer timer;
+	ktime_t frame_start;
+	u32 event_line;
+
+	irq_handler_t handler;
+	void *arg;
+};
+
+struct cdc_sim_timing {
+	u32 htotal;
+	u32 vtotal;
+	u64 line_ns;
+};
+
+static bool cdc_sim_get_timing (struct cdc_sim *sim, struct cdc_sim_timing *t)
+{
+	u32 total = sim->regs[CDC_REG_GLOBAL_TOTAL_WIDTH];
+
+	t->htotal = (total >> 16) + 1;
+	t->vtotal = (total & 0xffff) + 1;
+
+	if (sim->clock_khz == 0 || t->htotal < 2 || t->vtotal < 2)
+		return false;
+
+	t->line_ns = div_u64((u64) t->htotal * 1000000, sim->clock_khz);
+
+	return t->line_ns > 0;
+}
+
+static u32 cdc_sim_vblank_line (struct cdc_sim *sim)
+{
+	return (sim->regs[CDC_REG_GLOBAL_ACTIVE_WIDTH] & 0xffff) + 1;
+}
+
+/* Returns the first line after 'line' at which the model has to do
+ * something, or U32_MAX if there is none left in this frame.
+ */
+static u32 cdc_sim_next_event (struct cdc_sim *sim,
+	const struct cdc_sim_timing *t, s64 line)
+{
+	u32 events[] = {
+		cdc_sim_vblank_line(sim),
+		sim->regs[CDC_REG_GLOBAL_LINE_IRQ_POSITION],
+	};
+	u32 next = U32_MAX;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(events); ++i) {
+		if (events[i] < t->vtotal && events[i] > line
+			&& events[i] < next)
+			next = events[i];
+	}
+
+	return next;
+}
+
+static void cdc_sim_latch (struct cdc_sim *sim)
+{
+	memcpy(sim->active, sim->regs, sim->size * sizeof(u32));
+	sim->regs[CDC_REG_GLOBAL_SHADOW_RELOAD] = 0;
+	sim->irq_status |= CDC_IRQ_RELOAD;
+}
+
+/* Schedules the next event, starting a new frame if needed. Returns false
+ * if no event is left at all.
+ */
+static bool cdc_sim_schedule (struct cdc_sim *sim, s64 after)
+{
+	struct cdc_sim_timing t;
+	u32 next;
+
+	if (!cdc_sim_get_timing(sim, &t))
+		return false;
+
+	next = cdc_sim_next_event(sim, &t, after);
+	if (next == U32_MAX) {
+		next = cdc_sim_next_event(sim, &t, -1);
+		if (next == U32_MAX)
+			return false;
+
+		sim->frame_start = ktime_add_ns(sim->frame_start,
+			t.line_ns * t.vtotal);
+	}
+
+	sim->event_line = next;
+	hrtimer_set_expires(&sim->timer,
+		ktime_add_ns(sim->frame_start, t.line_ns * next));
+
+	return true;
+}
+
+static enum hrtimer_restart cdc_sim_timer (struct hrtimer *timer)
+{
+	struct cdc_sim *sim = container_of(timer, struct cdc_sim, timer);
+	enum hrtimer_restart restart;
+	u32 line;
+	bool raise;
+
+	spin_lock(&sim->lock);
+
+	line = sim->event_line;
+
+	if (line == cdc_sim_vblank_line(sim)
+		&& (sim->regs[CDC_REG_GLOBAL_SHADOW_RELOAD]
+			& CDC_REG_GLOBAL_SHADOW_RELOAD_VBLANK))
+		cdc_sim_latch(sim);
+
+	if (line == sim->regs[CDC_REG_GLOBAL_LINE_IRQ_POSITION])
+		sim->irq_status |= CDC_IRQ_LINE;
+
+	raise = sim->irq_status & sim->regs[CDC_REG_GLOBAL_IRQ_ENABLE];
+
+	spin_unlock(&sim->lock);
+
+	if (raise && sim->handler)
+		sim->handler(0, sim->arg);
+
+	/* Schedule after the handler ran, it may move the line IRQ */
+	spin_lock(&sim->lock);
+	if (sim->running && cdc_sim_schedule(sim, line)) {
+		restart = HRTIMER_RESTART;
+	} else {
+		sim->running = false;
+		restart = HRTIMER_NORESTART;
+	}
+	spin_unlock(&sim->lock);
+
+	return restart;
+}
+
+static void cdc_sim_position (struct cdc_sim *sim, u32 *x, u32 *y)
+{
+	struct cdc_sim_timing t;
+	s64 ns;
+	u64 pixels;
+	u64 lines;
+
+	*x = 0;
+	*y = 0;
+
+	if (!sim->running || !cdc_sim_get_timing(sim, &t))
+		return;
+
+	/* frame_start may already point to the upcoming frame */
+	ns = ktime_to_ns(ktime_sub(ktime_get(), sim->frame_start));
+	if (ns < 0)
+		ns += t.line_ns * t.vtotal;
+	if (ns < 0)
+		return;
+
+	pixels = div_u64((u64) ns * sim->clock_khz, 1000000);
+	lines = div_u64_rem(pixels, t.htotal, x);
+	div_u64_rem(lines, t.vtotal, y);
+}
+
+static u32 cdc_sim_sync_status (struct cdc_sim *sim)
+{
+	u32 sync = sim->regs[CDC_REG_GLOBAL_SYNC_SIZE];
+	u32 back_porch = sim->regs[CDC_REG_GLOBAL_BACK_PORCH];
+	u32 active = sim->regs[CDC_REG_GLOBAL_ACTIVE_WIDTH];
+	u32 status = 0;
+	u32 x, y;
+
+	cdc_sim_position(sim, &x, &y);
+
+	if (y > (back_porch & 0xffff) && y <= (active & 0xffff))
+		status |= CDC_REG_GLOBAL_SYNC_STATUS_V_ACTIVE;
+	if (x > (back_porch >> 16) && x <= (active >> 16))
+		status |= CDC_REG_GLOBAL_SYNC_STATUS_H_ACTIVE;
+	if (y <= (sync & 0xffff))
+		status |= CDC_REG_GLOBAL_SYNC_STATUS_VSYNC;
+	if (x <= (sync >> 16))
+		status |= CDC_REG_GLOBAL_SYNC_STATUS_HSYNC;
+
+	return status;
+}
+
+u32 cdc_sim_read_reg (struct cdc_sim *sim, u32 reg)
+{
+	unsigned long flags;
+	u32 x, y;
+	u32 val;
+
+	if (reg >= sim->size)
+		return 0;
+
+	spin_lock_irqsave(&sim->lock, flags);
+	switch (reg) {
+	case CDC_REG_GLOBAL_IRQ_STATUS:
+		val = sim->irq_status;
+		break;
+	case CDC_REG_GLOBAL_POSITION:
+		cdc_sim_position(sim, &x, &y);
+		val = (x << 16) | y;
+		break;
+	case CDC_REG_GLOBAL_SYNC_STATUS:
+		val = cdc_sim_sync_status(sim);
+		break;
+	default:
+		val = sim->regs[reg];
+		break;
+	}
+	spin_unlock_irqrestore(&sim->lock, flags);
+
+	return val;
+}
+
+void cdc_sim_write_reg (struct cdc_sim *sim, u32 reg, u32 val)
+{
+	unsigned long flags;
+	bool start = false;
+	bool stop = false;
+
+	if (reg >= sim->size)
+		return;
+
+	spin_lock_irqsave(&sim->lock, flags);
+	if (reg >= CDC_LAYER_SPAN) {
+		switch (reg % CDC_LAYER_SPAN) {
+		case CDC_REG_LAYER_CONFIG_1:
+		case CDC_REG_LAYER_CONFIG_2:
+			break;
+		default:
+			sim->regs[reg] = val;
+			break;
+		}
+	} else {
+		switch (reg) {
+		case CDC_REG_GLOBAL_HW_REVISION:
+		case CDC_REG_GLOBAL_LAYER_COUNT:
+		case CDC_REG_GLOBAL_CONFIG1:
+		case CDC_REG_GLOBAL_CONFIG2:
+		case CDC_REG_GLOBAL_IRQ_STATUS:
+		case CDC_REG_GLOBAL_POSITION:
+		case CDC_REG_GLOBAL_SYNC_STATUS:
+			/* read only */
+			break;
+		case CDC_REG_GLOBAL_IRQ_CLEAR:
+			sim->irq_status &= ~val;
+			break;
+		case CDC_REG_GLOBAL_SHADOW_RELOAD:
+			if (val & CDC_REG_GLOBAL_SHADOW_RELOAD_IMMEDIATE)
+				cdc_sim_latch(sim);
+			else
+				sim->regs[reg] |=
+					val & CDC_REG_GLOBAL_SHADOW_RELOAD_VBLANK;
+			break;
+		case CDC_REG_GLOBAL_CONTROL:
+			sim->regs[reg] = val;
+			if ((val & CDC_REG_GLOBAL_CONTROL_ENABLE) && !sim->running) {
+				sim->frame_start = ktime_get();
+				sim->running = cdc_sim_schedule(sim, -1);
+				start = sim->running;
+			} else if (!(val & CDC_REG_GLOBAL_CONTROL_ENABLE)
+				&& sim->running) {
+				sim->running = false;
+				stop = true;
+			}
+			break;
+		default:
+			sim->regs[reg] = val;
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&sim->lock, flags);
+
+	if (start)
+		hrtimer_start_expires(&sim->timer, HRTIMER_MODE_ABS);
+	if (stop)
+		hrtimer_try_to_cancel(&sim->timer);
+}
+
+void cdc_sim_set_irq_handler (struct cdc_sim *sim, irq_handler_t handler,
+	void *arg)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&sim->lock, flags);
+	sim->handler = handler;
+	sim->arg = arg;
+	spin_unlock_irqrestore(&sim->lock, flags);
+}
+
+void cdc_sim_set_pixel_clock (struct cdc_sim *sim, unsigned int khz)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&sim->lock, flags);
+	sim->clock_khz = khz;
+	spin_unlock_irqrestore(&sim->lock, flags);
+}
+
+int cdc_sim_init (struct cdc_device *cdc)
+{
+	struct cdc_sim *sim;
+	cdc_hw_revision_t hwrev = { 0 };
+	cdc_config1_t conf1 = { 0 };
+	cdc_config2_t conf2 = { 0 };
+	unsigned int i;
+
+	if (sim_layers == 0) {
+		dev_err(cdc->dev, "simulated CDC needs at least one layer\n");
+		return -EINVAL;
+	}
+
+	if (sim_layers > CDC_MAX_LAYERS) {
+		dev_warn(cdc->dev, "limiting simulated CDC to %u layers\n",
+			CDC_MAX_LAYERS);
+		sim_layers = CDC_MAX_LAYERS;
+	}
+
+	sim = devm_kzalloc(cdc->dev, sizeof(*sim), GFP_KERNEL);
+	if (sim == NULL)
+		return -ENOMEM;
+
+	sim->size = CDC_LAYER_SPAN * (sim_layers + 1);
+	sim->regs = devm_kcalloc(cdc->dev, sim->size, sizeof(u32), GFP_KERNEL);
+	sim->active = devm_kcalloc(cdc->dev, sim->size, sizeof(u32),
+		GFP_KERNEL);
+	if (sim->regs == NULL || sim->active == NULL)
+		return -ENOMEM;
+
+	sim->cdc = cdc;
+	spin_lock_init(&sim->lock);
+	hrtimer_init(&sim->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	sim->timer.function = cdc_sim_timer;
+
+	hwrev.bits.m_major = 2;
+	hwrev.bits.m_minor = 1;
+
+	conf1.bits.m_out_width_red = 8;
+	conf1.bits.m_out_width_green = 8;
+	conf1.bits.m_out_width_blue = 8;
+	conf1.bits.m_shadow_regs = 1;
+	conf1.bits.m_bg_color = 1;
+	conf1.bits.m_line_irq_pos = 1;
+	conf1.bits.m_timing = 1;
+	conf1.bits.m_irq_pol = 1;
+	conf1.bits.m_sync_pol = 1;
+	conf1.bits.m_status_regs = 1;
+	conf1.bits.m_config_reading = 1;
+	conf1.bits.m_gamma = 1;
+
+	conf2.bits.m_bus_width = 3; /* 8 byte */
+	conf2.bits.m_bg_layer = 1;
+
+	sim->regs[CDC_REG_GLOBAL_HW_REVISION] = hwrev.m_data;
+	sim->regs[CDC_REG_GLOBAL_LAYER_COUNT] = sim_layers;
+	sim->regs[CDC_REG_GLOBAL_CONFIG1] = conf1.m_data;
+	sim->regs[CDC_REG_GLOBAL_CONFIG2] = conf2.m_data;
+	/* Overlays scale, convert YCbCr and have an alpha plane, primary and
+	 * cursor have a CLUT
+	 */
+	for (i = 1; i + 1 < sim_layers; ++i) {
+		sim->regs[CDC_LAYER_SPAN * (i + 1) + CDC_REG_LAYER_CONFIG_1] =
+			CDC_REG_LAYER_CONFIG_ALPHA_PLANE;
+		sim->regs[CDC_LAYER_SPAN * (i + 1) + CDC_REG_LAYER_CONFIG_2] =
+			CDC_REG_LAYER_CONFIG_SCALER_ENABLED
+			| CDC_REG_LAYER_CONFIG_YCBCR_ENABLED;
+	}
+	memcpy(sim->active, sim->regs, sim->size * sizeof(u32));
+
+	cdc->sim = sim;
+
+	dev_info(cdc->dev, "using simulated CDC with %u layers\n", sim_layers);
+
+	return 0;
+}
+
+void cdc_sim_fini (struct cdc_device *cdc)
+{
+	struct cdc_sim *sim = cdc->sim;
+	unsigned long flags;
+
+	if (sim == NULL)
+		return;
+
+	spin_lock_irqsave(&sim->lock, flags);
+	sim->running = false;
+	spin_unlock_irqrestore(&sim->lock, flags);
+
+	hrtimer_cancel(&sim->timer);
+}
+
+/*******************************************************************************
+ * Virtual output
+ *
+ * The model has no encoder or panel described in the device tree, so it comes
+ * with a virtual connector offering the standard non-EDID modes.
+ */
+
+struct cdc_sim_output {
+	struct drm_encoder encoder;
+	struct drm_connector connector;
+	struct cdc_device *cdc;
+};
+
+#define to_cdc_sim_output(c) \
+        container_of(c, struct cdc_sim_output, connector)
+
+static int cdc_sim_connector_get_modes (struct drm_connector *connector)
+{
+	int count;
+
+	count = drm_add_modes_noedid(connector, CDC_MAX_WIDTH, CDC_MAX_HEIGHT);
+	drm_set_preferred_mode(connector, 800, 600);
+
+	return count;
+}
+
+static struct drm_encoder *cdc_sim_connector_best_encoder (
+	struct drm_connector *connector)
+{
+	return &to_cdc_sim_output(connector)->encoder;
+}
+
+static const struct drm_connector_helper_funcs connector_helper_funcs = {
+	.get_modes = cdc_sim_connector_get_modes,
+	.best_encoder = cdc_sim_connector_best_encoder,
+};
+
+static void cdc_sim_connector_destroy (struct drm_connector *connector)
+{
+	drm_connector_unregister(connector);
+	drm_connector_cleanup(connector);
+}
+
+static enum drm_connector_status cdc_sim_connector_detect (
+	struct drm_connector *connector, bool force)
+{
+	return connector_status_connected;
+}
+
+static const struct drm_connector_funcs connector_funcs = {
+	.dpms = drm_atomic_helper_connector_dpms,
+	.reset = drm_atomic_helper_connector_reset,
+	.detect = cdc_sim_connector_detect,
+	.fill_modes = drm_helper_probe_single_connector_modes,
+	.destroy = cdc_sim_connector_destroy,
+	.atomic_duplicate_state = drm_atomic_helper_connector_duplicate_state,
+	.atomic_destroy_state = drm_atomic_helper_connector_destroy_state,
+};
+
+static const struct drm_encoder_helper_funcs encoder_helper_funcs = {
+};
+
+static const struct drm_encoder_funcs encoder_funcs = {
+	.destroy = drm_encoder_cleanup,
+};
+
+int cdc_sim_output_init (struct cdc_device *cdc)
+{
+	struct cdc_sim_output *output;
+	int ret;
+
+	output = devm_kzalloc(cdc->dev, sizeof(*output), GFP_KERNEL);
+	if (output == NULL)
+		return -ENOMEM;
+
+	output->cdc = cdc;
+	cdc->neg_blank = false;
+	cdc->neg_pixclk = false;
+
+	output->encoder.possible_crtcs = 1;
+	output->encoder.possible_clones = 1;
+
+	ret = drm_encoder_init(cdc->ddev, &output->encoder, &encoder_funcs,
+		DRM_MODE_ENCODER_VIRTUAL, NULL);
+	if (ret < 0) {
+		dev_err(cdc->dev, "Error initializing virtual encoder: %d\n",
+			ret);
+		return ret;
+	}
+
+	drm_encoder_helper_add(&output->encoder, &encoder_helper_funcs);
+
+	ret = drm_connector_init(cdc->ddev, &output->connector,
+		&connector_funcs, DRM_MODE_CONNECTOR_VIRTUAL);
+	if (ret < 0) {
+		dev_err(cdc->dev, "Error initializing connector: %d\n", ret);
+		return ret;
+	}
+
+	drm_connector_helper_add(&output->connector, &connector_helper_funcs);
+
+	ret = drm_mode_connector_attach_encoder(&output->connector,
+		&output->encoder);
+	if (ret < 0) {
+		dev_err(cdc->dev, "Error attaching encoder and connector: %d\n",
+			ret);
+		return ret;
+	}
+
+	return 0;
+}
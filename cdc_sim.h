@@ -0,0 +1,30 @@
+/*
+ * cdc_sim.h  --  CDC Display Controller register model
+ *
+ * Copyright (C) 2017 TES Electronic Solutions GmbH
+ * Author: Christian Thaler <christian.thaler@tes-dst.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef CDC_SIM_H_
+#define CDC_SIM_H_
+
+#include <linux/interrupt.h>
+
+struct cdc_device;
+struct cdc_sim;
+
+int cdc_sim_init (struct cdc_device *cdc);
+void cdc_sim_fini (struct cdc_device *cdc);
+u32 cdc_sim_read_reg (struct cdc_sim *sim, u32 reg);
+void cdc_sim_write_reg (struct cdc_sim *sim, u32 reg, u32 val);
+void cdc_sim_set_irq_handler (struct cdc_sim *sim, irq_handler_t handler,
+	void *arg);
+void cdc_sim_set_pixel_clock (struct cdc_sim *sim, unsigned int khz);
+int cdc_sim_output_init (struct cdc_device *cdc);
+
+#endif /* CDC_SIM_H_ */
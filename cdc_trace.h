@@ -0,0 +1,207 @@
+/*
+ * cdc_trace.h  --  CDC Display Controller trace events
+ *
+ * Copyright (C) 2017 TES Electronic Solutions GmbH
+ * Author: Christian Thaler <christian.thaler@tes-dst.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#if !defined(CDC_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define CDC_TRACE_H_
+
+#include <linux/tracepoint.h>
+#include <linux/types.h>
+
+#include <drm/drmP.h>
+
+#include "cdc_drv.h"
+#include "cdc_regs.h"
+#include "cdc_hw.h"
+#include "cdc_kms.h"
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM cdc
+#define TRACE_INCLUDE_FILE cdc_trace
+
+/* Events carrying a scanout position read POSITION only when enabled */
+DECLARE_EVENT_CLASS(cdc_position,
+	TP_PROTO(struct cdc_device *cdc),
+	TP_ARGS(cdc),
+
+	TP_STRUCT__entry(
+		__field(u32, pos)
+	),
+
+	TP_fast_assign(
+		__entry->pos = cdc_read_reg(cdc, CDC_REG_GLOBAL_POSITION);
+	),
+
+	TP_printk("x=%u y=%u", __entry->pos >> 16, __entry->pos & 0xffff)
+);
+
+DEFINE_EVENT(cdc_position, cdc_flip_timeout,
+	TP_PROTO(struct cdc_device *cdc),
+	TP_ARGS(cdc)
+);
+
+DEFINE_EVENT(cdc_position, cdc_fifo_underrun,
+	TP_PROTO(struct cdc_device *cdc),
+	TP_ARGS(cdc)
+);
+
+DEFINE_EVENT(cdc_position, cdc_fifo_underrun_warn,
+	TP_PROTO(struct cdc_device *cdc),
+	TP_ARGS(cdc)
+);
+
+DEFINE_EVENT(cdc_position, cdc_bus_error,
+	TP_PROTO(struct cdc_device *cdc),
+	TP_ARGS(cdc)
+);
+
+TRACE_EVENT(cdc_atomic_check,
+	TP_PROTO(struct drm_atomic_state *state, int ret),
+	TP_ARGS(state, ret),
+
+	TP_STRUCT__entry(
+		__field(const void *, state)
+		__field(bool, allow_modeset)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__entry->state = state;
+		__entry->allow_modeset = state->allow_modeset;
+		__entry->ret = ret;
+	),
+
+	TP_printk("state=%p allow_modeset=%d ret=%d", __entry->state,
+		__entry->allow_modeset, __entry->ret)
+);
+
+DECLARE_EVENT_CLASS(cdc_commit,
+	TP_PROTO(struct cdc_device *cdc, struct cdc_commit *commit),
+	TP_ARGS(cdc, commit),
+
+	TP_STRUCT__entry(
+		__field(const void *, commit)
+		__field(bool, async)
+		__field(u32, pos)
+	),
+
+	TP_fast_assign(
+		__entry->commit = commit;
+		__entry->async = commit->async;
+		__entry->pos = cdc_read_reg(cdc, CDC_REG_GLOBAL_POSITION);
+	),
+
+	TP_printk("commit=%p async=%d x=%u y=%u", __entry->commit,
+		__entry->async, __entry->pos >> 16, __entry->pos & 0xffff)
+);
+
+DEFINE_EVENT(cdc_commit, cdc_commit_start,
+	TP_PROTO(struct cdc_device *cdc, struct cdc_commit *commit),
+	TP_ARGS(cdc, commit)
+);
+
+DEFINE_EVENT(cdc_commit, cdc_commit_swap,
+	TP_PROTO(struct cdc_device *cdc, struct cdc_commit *commit),
+	TP_ARGS(cdc, commit)
+);
+
+DEFINE_EVENT(cdc_commit, cdc_commit_flush,
+	TP_PROTO(struct cdc_device *cdc, struct cdc_commit *commit),
+	TP_ARGS(cdc, commit)
+);
+
+DEFINE_EVENT(cdc_commit, cdc_commit_latch,
+	TP_PROTO(struct cdc_device *cdc, struct cdc_commit *commit),
+	TP_ARGS(cdc, commit)
+);
+
+TRACE_EVENT(cdc_plane_update,
+	TP_PROTO(struct cdc_device *cdc, int layer, dma_addr_t addr),
+	TP_ARGS(cdc, layer, addr),
+
+	TP_STRUCT__entry(
+		__field(int, layer)
+		__field(u64, addr)
+		__field(u32, pos)
+	),
+
+	TP_fast_assign(
+		__entry->layer = layer;
+		__entry->addr = addr;
+		__entry->pos = cdc_read_reg(cdc, CDC_REG_GLOBAL_POSITION);
+	),
+
+	TP_printk("layer=%d addr=0x%llx x=%u y=%u", __entry->layer,
+		__entry->addr, __entry->pos >> 16, __entry->pos & 0xffff)
+);
+
+TRACE_EVENT(cdc_shadow_reload,
+	TP_PROTO(struct cdc_device *cdc, bool in_vblank),
+	TP_ARGS(cdc, in_vblank),
+
+	TP_STRUCT__entry(
+		__field(bool, in_vblank)
+		__field(u32, pos)
+	),
+
+	TP_fast_assign(
+		__entry->in_vblank = in_vblank;
+		__entry->pos = cdc_read_reg(cdc, CDC_REG_GLOBAL_POSITION);
+	),
+
+	TP_printk("%s x=%u y=%u", __entry->in_vblank ? "vblank" : "immediate",
+		__entry->pos >> 16, __entry->pos & 0xffff)
+);
+
+TRACE_EVENT(cdc_line_irq,
+	TP_PROTO(struct cdc_device *cdc, u32 status),
+	TP_ARGS(cdc, status),
+
+	TP_STRUCT__entry(
+		__field(u32, status)
+		__field(u32, line)
+		__field(u32, pos)
+	),
+
+	TP_fast_assign(
+		__entry->status = status;
+		__entry->line = cdc_read_reg(cdc,
+			CDC_REG_GLOBAL_LINE_IRQ_POSITION);
+		__entry->pos = cdc_read_reg(cdc, CDC_REG_GLOBAL_POSITION);
+	),
+
+	TP_printk("status=0x%x line=%u x=%u y=%u", __entry->status,
+		__entry->line, __entry->pos >> 16, __entry->pos & 0xffff)
+);
+
+TRACE_EVENT(cdc_vblank_event,
+	TP_PROTO(struct cdc_device *cdc, struct drm_crtc *crtc),
+	TP_ARGS(cdc, crtc),
+
+	TP_STRUCT__entry(
+		__field(u32, seq)
+		__field(u32, pos)
+	),
+
+	TP_fast_assign(
+		__entry->seq = drm_crtc_vblank_count(crtc);
+		__entry->pos = cdc_read_reg(cdc, CDC_REG_GLOBAL_POSITION);
+	),
+
+	TP_printk("seq=%u x=%u y=%u", __entry->seq, __entry->pos >> 16,
+		__entry->pos & 0xffff)
+);
+
+#endif /* CDC_TRACE_H_ */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#include <trace/define_trace.h>
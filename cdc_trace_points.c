@@ -0,0 +1,14 @@
+/*
+ * cdc_trace_points.c  --  CDC Display Controller trace events
+ *
+ * Copyright (C) 2017 TES Electronic Solutions GmbH
+ * Author: Christian Thaler <christian.thaler@tes-dst.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define CREATE_TRACE_POINTS
+#include "cdc_trace.h"